@@ -9,6 +9,9 @@
  * This header contains the declaration of all the functions needed to
  * use the Texas Instrument bq76930 Analog Front End (BMS MONITOR).
  *
+ * The driver is a template over the bq769x0 variant and the populated cell inputs
+ * (see bq769x0.hpp), so registers, balancing bits and adjacency rules of the pack are
+ * resolved at compile time. BQ76930 is the AFE configured in configuration.hpp.
  */
 
 #ifndef BQ76930_HPP_
@@ -19,15 +22,20 @@
 #include "timing.hpp"
 #include "pins.hpp"
 #include "configuration.hpp"
+#include "crc8.hpp"
+#include "bq769x0.hpp"
+#include "fixed_point.hpp"
 
 #include <stdlib.h>
 
 #include "SEGGER_RTT.h"
 
-/* I2C Address of the AFE */
+/* Default I2C Address of the AFE */
 #define I2C_ADDRESS		0x08
 /* Key of the polynomial CRC error detection */
 #define CRC_KEY			7
+/* Number of configuration registers, from CELLBAL1 (0x01) up to CC_CFG (0x0B) */
+#define CONFIG_REGISTERS	11
 
 /*
  * bq76930 Registers Map
@@ -54,6 +62,7 @@ enum TI_Register_ID : uint8_t
 	 */
 	cellbal1 	= 0x01,
 	cellbal2 	= 0x02,
+	cellbal3	= 0x03,		//bq76940 only
 
 	/*
 	 * System Configuration registers.
@@ -109,6 +118,7 @@ enum TI_Register_ID : uint8_t
 //	vc9_lo 		= 0x1D,
 	vc10_hi 	= 0x1E,
 	vc10_lo 	= 0x1F,
+	/* VC11..VC15 (0x20..0x29) are only available on the bq76940 */
 
 	/*
 	 * Battery ADC reading registers.
@@ -144,25 +154,141 @@ enum TI_Register_ID : uint8_t
 };
 
 
-class BQ76930
+template<bq769x0::variant V, uint16_t TAPS>
+class BQ769x0
 {
+public:
+
+	/* Compile-time cell map and balancing plans of the pack */
+	typedef bq769x0::layout<V, TAPS, bms_config::max_balancing_cells> pack_layout;
+
+	static constexpr int n_cells = pack_layout::n_cells;
+
+	/*
+	 * Largest cell voltage adc_to_voltage() can return (mV): full scale reading with the
+	 * largest trimmed gain (396 µV/LSB) and offset (+127 mV). Input range of the averages.
+	 */
+	static constexpr uint32_t MAX_CELL_VOLTAGE = 6614;
+
 private:
 
+	uint8_t address = I2C_ADDRESS;							//I2C address of this AFE (see init)
+	int8_t mux_channel = -1;								//I2C mux channel of this AFE, -1 when it's directly on the bus
+	uint8_t mux_command = 0;								//Channel selection byte sent to the I2C mux
+	i2c::transaction mux_transaction = {};					//Asynchronous I2C mux channel selection (see select)
+	bool mux_pending = false;								//TRUE once mux_transaction has been queued
+
 	uint8_t read_data[2] = {0};								//In READ operations, data[0] = register_value and data[1] = CRC received from the I2C slave
 	uint8_t write_data[3] = {0};							//In WRITE operations, data[0] = register_address, data[1] = value to write and data[2] is the calculated CRC
 	uint8_t voltage_buffer_high[2] = {0};					//Buffer in which voltage readings (high register) and its respective CRC are stored
 	uint8_t voltage_buffer_low[2] = {0};					//Buffer in which voltage readings (low register) and its respective CRC are stored
+	uint8_t battery_buffer[4] = {0};						//Buffer for the BAT_HI/BAT_LO block read
 
 	uint8_t crc_wr[3] = {0};								//CRC_WR is used to calculate CRC8 at every write operation (and it's sent along the data)
 	uint8_t crc_rd[2] = {0};								//CRC_RD is used to calculate CRC8 upon every read operation
 
+	uint8_t block_buffer[2 * pack_layout::cell_registers] = {0};			//Buffer for block reads, every register value is followed by its CRC
+
+	uint8_t cell_command = 0;								//Register address sent by the asynchronous cell voltages read
+	i2c::transaction cell_transaction = {};					//Asynchronous cell voltages read (see start_cellvoltages)
+	bool cell_pending = false;								//TRUE while cell_transaction is queued or on the bus
+
+	/*
+	 * Shadow copy of the writable configuration registers (CELLBAL1..CC_CFG), indexed by
+	 * register address, and bitmask (1 << address) of the entries holding a known value.
+	 * It's used to skip writes that wouldn't change anything in the AFE.
+	 */
+	uint8_t shadow_registers[cc_cfg + 1] = {0};
+	uint16_t shadow_valid = 0;
+	uint8_t config_buffer[2 * CONFIG_REGISTERS] = {0};		//Buffer for the configuration registers readback
+
+	uint8_t cc_mode = 0;									//Coulomb counter bits kept in every sys_ctrl2 write (CC_EN, see init)
+	uint8_t cc_buffer[4] = {0};								//Buffer for the CC_HI/CC_LO block read
+
+	/*
+	 * Coulomb counter accumulator: raw CC readings integrated since init_stateofcharge(),
+	 * one count is a charge of CC_CHARGE nAs.
+	 * 64 bits hold more than 10^6 Ah, so it can't overflow in the lifetime of the pack.
+	 */
+	int64_t cc_accumulator = 0;
+	int64_t initial_charge = 0;								//Charge at init_stateofcharge() (CC counts)
+	int64_t pack_capacity = 1;								//Full charge (CC counts)
+	/*
+	 * State of charge per CC count (0.1%, Q48), computed once by init_stateofcharge():
+	 * state_of_charge = charge x soc_factor >> SOC_SHIFT, with charge <= pack_capacity the
+	 * product stays below 1000 x 2^48.
+	 */
+	int64_t soc_factor = 0;
+
+	/*
+	 * Removes from a register value the bits that can't be cached: LOAD_PRESENT in sys_ctrl1
+	 * is read-only
+	 */
+	uint8_t cached_bits(const TI_Register_ID reg, uint8_t value)
+	{
+		if (reg == sys_ctrl1) return value & 0x7F;
+		return value;
+	}
+
+	/*
+	 * TRUE if the register is cached in the shadow copy (CELLBAL registers missing on
+	 * the chip are left out)
+	 */
+	bool is_shadowed(const TI_Register_ID reg)
+	{
+		return reg >= cellbal1 && reg <= cc_cfg && (reg > cellbal3 || reg < cellbal1 + pack_layout::balancing_registers);
+	}
+
+	/*
+	 * Routes the I2C mux to this AFE before its next transaction.
+	 * The selection is queued on the bus without waiting, so it always precedes the
+	 * transaction that follows it, and skipped when the mux already points here.
+	 */
+	void select(void);
+
+	/*
+	 * Verifies the CRCs of a block read (see read_block).
+	 * Returns a bitmask with bit i set if the CRC of the i-th register is valid.
+	 */
+	uint32_t check_block(uint8_t length, const uint8_t *data);
+
+	/*
+	 * ADC gain (Q16 mV/LSB) used in the voltage conversions: it's adc_gain_uv / 1000 as fixed point,
+	 * so the conversion is a multiply and shift instead of a division (see read_calibration).
+	 */
+	uint32_t gain_factor = (uint32_t(377) << 16) / 1000;
+
+	/*
+	 * Converts a 14 bits cell ADC reading into mV, using adc_gain_uv and adc_offset_mv
+	 */
+	uint16_t adc_to_voltage(uint16_t adc_data)
+	{
+		return uint16_t(((adc_data * gain_factor) >> 16) + adc_offset_mv);
+	}
+
+	/*
+	 * Converts a voltage (mV) into the OV_TRIP/UV_TRIP register value:
+	 * from the 14bits ADC value, remove 2MSB and 4LSB and obtain the 8bit value to write
+	 */
+	uint8_t trip_threshold(uint16_t voltage)
+	{
+		return uint8_t((((int32_t(voltage) - adc_offset_mv) * 1000 / adc_gain_uv) >> 4) & 0xFF);
+	}
+
+	/*
+	 * Reads the factory trimmed ADC gain and offset from ADC_GAIN1/2 and ADC_OFFSET
+	 * and precomputes gain_factor. If the registers can't be read, the typical values
+	 * (377µV/LSB, +48mV) are kept.
+	 */
+	void read_calibration(void);
+
 	/*
 	 * This function retrieves the minimum voltage in the voltage_readings buffer
 	 */
 	void min()
 	{
 		min_voltage = voltage_readings[0];
-		for (int i=0; i<bms_config::n_cells; ++i)
+		for (int i=0; i<n_cells; ++i)
 		{
 				if (voltage_readings[i] < min_voltage)
 				{
@@ -176,7 +302,7 @@ private:
 	void max()
 	{
 		max_voltage = voltage_readings[0];
-		for (int i=0; i<bms_config::n_cells; ++i)
+		for (int i=0; i<n_cells; ++i)
 		{
 			if (voltage_readings[i] > max_voltage)
 			{
@@ -189,44 +315,16 @@ private:
 	 */
 	void avg()
 	{
-		avg_voltage = 0;
-		for (int i=0; i<bms_config::n_cells; ++i)
-		{
-			avg_voltage += voltage_readings[i];
-		}
-
-		avg_voltage = uint16_t(avg_voltage / bms_config::n_cells);
-	}
-
-	/*
-	 * This function checks whether one cell is present in the array of balancing cells
-	 */
-	bool is_balancing(int cell)
-	{
-		for (int i=0; i<bms_config::max_balancing_cells; ++i)
-		{
-			if (balancing_cells[i] == cell)
-			{
-				return true;
-			}
-		}
-		return false;
-	}
+		typedef fixed::ratio<1, n_cells, n_cells * MAX_CELL_VOLTAGE> average;
+		static_assert(average::max_error == 0, "Inexact cell voltage average");
 
-	/*
-	 * This function checks for adjacency of cells when balancing, as -by datasheet-
-	 * it's not possible to balance adjacent cells simultaneously (within same subset).
-	 * In particular, considering that cells 4, 8 and 9 are shorted, it checks that
-	 * cells 1-2, 2-3 and 6-7 don't need to be balanced at the same time
-	 */
-	bool check_adjacency(int cell)
-	{
-		if ((cell == 1 && is_balancing(0)) || (cell == 2 && is_balancing(1)) || (cell == 5 && is_balancing(4)))
+		uint32_t sum = 0;
+		for (int i=0; i<n_cells; ++i)
 		{
-			return false;
+			sum += voltage_readings[i];
 		}
 
-		return true;
+		avg_voltage = uint16_t(average::apply(sum));
 	}
 
 	/*
@@ -238,14 +336,14 @@ private:
 	{
 		int ok_cells = 0;
 
-		for (int cell=0; cell<bms_config::n_cells; ++cell)
+		for (int cell=0; cell<n_cells; ++cell)
 		{
 			if (abs(int(voltage_readings[cell] - min_voltage)) < bms_config::balancing_stop)
 			{
 				ok_cells++;
 			}
 		}
-		if (ok_cells == 7)
+		if (ok_cells == n_cells)
 		{
 			return true;
 		}
@@ -258,15 +356,20 @@ public:
 	 * This variables are passed throughout the entire program and they're used to store the
 	 * cells voltages and the battery voltage.
 	 */
-	uint16_t voltage_readings[bms_config::n_cells] 		= {0};
+	uint16_t voltage_readings[n_cells] 					= {0};
 	uint16_t battery_voltage 							= 0;
+	/*
+	 * State of charge of the LVB (0.1%, 1000 = fully charged), integrated from the
+	 * coulomb counter readings, and current measured by the coulomb counter (mA,
+	 * positive when charging) averaged over the last 250ms.
+	 */
 	int16_t state_of_charge 							= 0;
+	int16_t cc_current 									= 0;
 
-	/* This array is used when enabling cells balacing, to be sure that
-	 * no adjacent cells are balanced at the same time
-	 * They're initialized as 7 as it's not in the range of possible cells
-	 * (check the if condition in check_balancing */
-	int balancing_cells[bms_config::max_balancing_cells]= {7};
+	/* Cells currently balancing, one bit per connected cell (bit 0 = cell 0).
+	 * It's always one of the valid plans (no adjacent cells, at most
+	 * max_balancing_cells bits set), see check_balancing */
+	uint16_t balancing_mask								= 0;
 
 	/*
 	 * ERROR BIT
@@ -276,6 +379,20 @@ public:
 	 */
 	bool error_bit 										= false;
 
+	/*
+	 * CRC ERRORS
+	 * Number of register values discarded during block reads because the CRC sent by the
+	 * bq76930 didn't match the one calculated on the received data.
+	 * A discarded cell keeps its previous reading until the next sweep.
+	 */
+	uint16_t crc_errors 								= 0;
+
+	/*
+	 * Number of configuration registers found different from the shadow copy during
+	 * readback (see check_registers), usually due to an AFE reset.
+	 */
+	uint16_t register_mismatches 						= 0;
+
 	/*
 	 * BALANCING ENABLED
 	 * This variable is set to TRUE whenever the LPC is told to start the balancing procedure.
@@ -283,6 +400,13 @@ public:
 	 */
 	bool balancing_enabled 								= false;
 
+	/*
+	 * ALERT FLAG
+	 * Set by the ALERT pin interrupt (afe_alert_interrupt) whenever the AFE raises one of the
+	 * SYS_STAT bits (fault or CC_READY). Cleared by alert_pending().
+	 */
+	volatile bool alert_flag 							= false;
+
 	/*
 	 * Minimum cell voltage of the LVB (used to enable balancing of cells)-
 	 *
@@ -296,11 +420,14 @@ public:
 	 * ADC Gain and ADC Offset values.
 	 * Those data are stored in registers ADC_GAIN1/2 (0x50, 0x59) and ADC_OFFSET (0x51)
 	 *
-	 * Since they don't change over time, we can read out those values at the beginning and then
-	 * store them in those two values.
+	 * Since they don't change over time, we read out those values in init() and then
+	 * store them in those two values (initialized with the typical ones).
+	 * adc_gain_uv = 365 + ADCGAIN[4:0] µV/LSB, with ADCGAIN[4:3] in ADC_GAIN1[3:2] and ADCGAIN[2:0]
+	 * in ADC_GAIN2[7:5]. adc_offset_mv is a signed value.
+	 * Not named after the registers: adc_offset is already the register ID.
 	 */
-	const uint16_t ADC_GAIN		= 377;		//	377 µV/LSB
-	const uint8_t ADC_OFFSET	= 48;		//	+48 mV
+	uint16_t adc_gain_uv		= 377;		//	377 µV/LSB
+	int8_t adc_offset_mv		= 48;		//	+48 mV
 	/*
 	 * State of Charge LSB value.
 	 * It's used to retrieve the value of the current state of charge of the battery.
@@ -309,18 +436,35 @@ public:
 	 *
 	 * Since the value of the LSB is decimal, calculations are made using nV/LSB and
 	 * then dividing the result by a factor of 1000 (ARM-Cortex M0 doesn't have FP unit).
+	 * The division by 1000 x RSNS is folded into a multiply and shift (see cc_ratio).
+	 */
+	static constexpr uint16_t CC_LSB	= 8440;	//8.44 µV/LSB
+	/*
+	 * Coulomb counter integration period (ms), one reading every 250ms in continuous mode.
+	 * A single CC reading corresponds to a charge of CC_READING x CC_CHARGE, where
+	 * CC_CHARGE = CC_LSB x CC_PERIOD / RSNS [nV x ms / mΩ = nAs]
+	 */
+	static constexpr uint16_t CC_PERIOD	= 250;
+	static constexpr int32_t CC_CHARGE	= int32_t(CC_LSB) * CC_PERIOD / bms_config::sense_resistor;
+	/*
+	 * CC reading to mA: CC_READING x CC_LSB / 1000 / RSNS, over the full 16 bits range
 	 */
-	const uint16_t CC_LSB		= 8440;	//8.44 µV/LSB
+	typedef fixed::ratio<CC_LSB, 1000 * bms_config::sense_resistor, 32768> cc_ratio;
+	static_assert(cc_ratio::max_error <= 2, "Coulomb counter current conversion too coarse");
 	/*
-	 * Overvoltage (OV) and Undervoltage (UV) thresholds
+	 * Fractional bits of soc_factor
+	 */
+	static constexpr int SOC_SHIFT		= 48;
+	/*
+	 * Overvoltage (OV) and Undervoltage (UV) thresholds (mV)
 	 * Those values will be stored in OV_/UV_TRIP registers (0x09, 0x0A)
 	 *
 	 * Calculation:
 	 * OV_/UV_TRIP = (OV_/UV_FULL - ADC_OFFSET) / ADC_GAIN
-	 * From the 14bits value obtained, remove 2MSB and 4LSB and obtain the 8bit value to write
+	 * using the AFE's own adc_gain_uv and adc_offset_mv (see trip_threshold)
 	 */
-	const uint8_t OV_THRESH		= 0xB1;		//4.20V
-	const uint8_t UV_THRESH		= 0xF0;		//3.05V
+	const uint16_t OV_THRESH	= 4200;		//4.20V
+	const uint16_t UV_THRESH	= 3050;		//3.05V
 	/*
 	 * OV and UV protection delay.
 	 * Value 0x00 corresponds to 1sec delay for both Undervoltage and Overvoltage faults
@@ -353,14 +497,21 @@ public:
 	/*
 	 * Charge and Discharge FET closing values, and FET clearing value.
 	 * Write them according to the FET that needs to be closed in AFE's register sys_ctrl2.
-	 *
-	 * First 4 bits of the register have to be set to 0010 in order to enable state of charge (CC)
-	 * "one shot" readings.
 	 */
-	const uint8_t FET_DISABLE	= 0x20;
-	const uint8_t CHG_ON		= 0x21;
-	const uint8_t DSG_ON		= 0x22;
-	const uint8_t FET_ON		= 0x23;
+	const uint8_t FET_DISABLE	= 0x00;
+	const uint8_t CHG_ON		= 0x01;
+	const uint8_t DSG_ON		= 0x02;
+	const uint8_t FET_ON		= 0x03;
+	/*
+	 * State of charge (CC) continuous readings enable, bit 6 of sys_ctrl2.
+	 * A new reading is available every 250ms, signaled by CC_READY.
+	 */
+	const uint8_t CC_EN			= 0x40;
+	/*
+	 * CC_READY bit of the sys_stat register.
+	 * Set by the AFE every 250ms in CC continuous mode, together with the cell ADC refresh.
+	 */
+	const uint8_t CC_READY		= 0x80;
 	/*
 	 * Disables balancing operations by simply clearing the cells-correspondent bits in cellbalx registers
 	 */
@@ -369,15 +520,30 @@ public:
 
 	/*
 	 * Initializes the I2C bus and configures the required thresholds into the bq76930 chip.
+	 *
+	 * \i2c_address			I2C address of the AFE
+	 * \i2c_mux_channel		Channel of the I2C mux the AFE is behind, -1 if it's directly on the bus
 	 */
-	void init(void);
+	void init(uint8_t i2c_address = I2C_ADDRESS, int8_t i2c_mux_channel = -1);
 	/*
-	 * This function enables balancing of a single cell (or multiple ones) by writing a 1
-	 * on one of the two CELLBAL registers (0x01 for cells 0..5, 0x02 for cells 6..10)
+	 * Enables the ALERT acquisition mode: the ALERT pin (PIO0_2) is configured as rising edge
+	 * interrupt, so the main loop is signaled every 250ms (CC_READY, the coulomb counter runs in
+	 * continuous mode) as soon as new readings are available, or immediately upon faults.
+	 */
+	void init_alert(void);
+	/*
+	 * TRUE if the AFE has raised ALERT since the last call, or if it's still holding it
+	 * (a fault has not been cleared yet). Clears the alert flag.
+	 */
+	bool alert_pending(void);
+	/*
+	 * This function enables balancing of a set of cells by writing every CELLBAL register
+	 * of the chip once (0x01 for inputs VC1..VC5, 0x02 for VC6..VC10, 0x03 for VC11..VC15).
+	 * Cells not in the set stop balancing.
 	 *
-	 * \cell indicates the particular cell to balance
+	 * \cells bitmask of the cells to balance (bit 0 = cell 0)
 	 */
-	void enable_balancing(int cell);
+	void enable_balancing(uint16_t cells);
 	/*
 	 * This function disables balancing (writes a 0 on all bits of CELLBAL registers).
 	 */
@@ -387,6 +553,9 @@ public:
 	 * We can avoid to care about OV-UV protections, as on the datasheet it's stated that
 	 * cells balancing doesn't affect nor trigger such protections.
 	 *
+	 * When activating, the cells above the minimum are ranked by their deviation from it
+	 * and the valid plan (see bq769x0::balancing_plans) with the highest total deviation is enabled.
+	 *
 	 * \param activate is used to check whether check_balancing is used to enable or
 	 * to disable the balancing procedure. By default it activates it
 	 */
@@ -401,14 +570,29 @@ public:
 	 */
 	uint16_t read_voltage(const TI_Register_ID reg_hi, const TI_Register_ID reg_lo);
 	/*
-	 * This function uses the read_voltage(reg_hi, reg_lo) function above and retrieves all the
-	 * cell voltages in a single run.
-	 * The function above is therefore used to read the intermediate results (thus the single
-	 * cell readout), then the return value will be stored in the voltage_readings buffer.
+	 * This function retrieves all the cell voltages in a single run.
+	 * Registers VC1_HI..VCx_LO (last input of the chip) are fetched with one auto-incrementing block read
+	 * (see read_block), then every connected cell is decoded into the voltage_readings buffer.
+	 * Cells whose CRC check fails keep their previous value.
 	 *
 	 * Each value is displayed in mV
 	 */
 	void read_cellvoltages(void);
+	/*
+	 * Queues the cell voltages block read on the I2C bus and returns immediately.
+	 * The following call to read_cellvoltages() only waits for the transaction to
+	 * complete and decodes the results, so other work (i.e. ADC measurements) can be
+	 * done while the bus is busy.
+	 */
+	void start_cellvoltages(void);
+	/*
+	 * TRUE if read_cellvoltages() won't wait: the block read queued by start_cellvoltages()
+	 * has completed (or none is queued)
+	 */
+	bool cellvoltages_done(void)
+	{
+		return !cell_pending || cell_transaction.done;
+	}
 	/*
 	 * This function reads the voltage of the battery pack itself, retrieving
 	 * the result from the two registers bat_hi and bat_lo in the bq76930.
@@ -419,23 +603,62 @@ public:
 	 */
 	void read_battery_voltage(void);
 	/*
-	 * This function reads the LVB state of charge, retrieving the result
-	 * from the two registers cc_hi and cc_lo in the bq76930.
-	 * The selected way is CC_ONESHOT, to prevent triggering interrupts
-	 * on the ALERT pin that may cause unexpected behaviors.
+	 * Sets the starting point of the state of charge integration.
+	 *
+	 * \capacity			Pack capacity (mAh)
+	 * \initial_soc		State of charge at this moment (0.1%)
+	 */
+	void init_stateofcharge(uint16_t capacity, int16_t initial_soc);
+	/*
+	 * This function reads the coulomb counter result from the two registers cc_hi and cc_lo
+	 * in the bq76930 and integrates it into the LVB state of charge.
+	 *
+	 * The coulomb counter runs in continuous mode, so this has to be called exactly once
+	 * for every CC_READY (every 250ms) raised by the AFE, then CC_READY has to be cleared.
 	 */
 	void read_stateofcharge(void);
 	/*
 	 * Read a single register value.
 	 */
 	uint8_t read_register(const TI_Register_ID reg);
+	/*
+	 * Read \length subsequent registers, starting from \reg, in a single I2C transaction.
+	 *
+	 * The bq76930 auto-increments the register address and sends a CRC after every byte:
+	 * the first CRC covers the slave address (read) and the first data byte, each of the
+	 * following CRCs covers its own data byte only.
+	 * \data receives 2 x \length bytes, each register value followed by its received CRC.
+	 *
+	 * Returns a bitmask with bit i set if the CRC of register (reg + i) is valid.
+	 */
+	uint32_t read_block(const TI_Register_ID reg, uint8_t length, uint8_t *data);
 	/*
 	 * Write data on one of the 8 bits registers of the bq76930 monitor.
 	 *
 	 * In order to write a 16 bits value (for subsequent registers) this function
 	 * has to be called twice with the according \reg values.
+	 *
+	 * Writes to the configuration registers (CELLBAL1..CC_CFG) are skipped when the
+	 * shadow copy says the AFE already holds \data. Use \force to write anyway.
 	 */
-	void write_register(const TI_Register_ID reg, uint8_t data);
+	void write_register(const TI_Register_ID reg, uint8_t data, bool force = false);
+	/*
+	 * Drops the shadow copy of a register, so the next write goes through.
+	 * Needed whenever the AFE may have changed the register on its own
+	 * (i.e. sys_ctrl2 FET bits are cleared by the AFE upon faults).
+	 */
+	void invalidate_register(const TI_Register_ID reg)
+	{
+		shadow_valid &= ~(1 << reg);
+	}
+	/*
+	 * Periodic readback of the configuration registers.
+	 * CELLBAL1..CC_CFG are read in a single block and compared with the shadow copy:
+	 * mismatching registers are written again (restoring the configuration after an AFE
+	 * reset), apart from sys_ctrl2 whose shadow is just updated, as FETs could have been
+	 * opened by the AFE protections. Scheduled every bms_config::register_verify_period ms.
+	 */
+	void check_registers(void);
 	/*
 	 * CRC calculation.
 	 * Cyclic Redundancy Check (CRC) is used by the bq76930 monitor during read/write
@@ -444,45 +667,28 @@ public:
 	 * and calculated after every read operation.
 	 * In any case, if there's a mismatch a NACK will be sent (to Master in WR, to Slave in RD)
 	 *
-	 * The CRC polynomial is x8 + x2 + x + 1, with initial value 0.
-	 *
-	 * The code is derived from the example code that can be found at:
-	 * www.ti.com/product/BQ76940/toolssoftware (under "Software" tab)
+	 * The CRC polynomial is x8 + x2 + x + 1, with initial value 0 (key CRC_KEY).
+	 * It's computed through a compile-time generated lookup table (see crc8.hpp).
 	 *
 	 * Parameters:
 	 * \input				Monitor's I2C address and data to be sent
 	 * \length				Length of the input address_and_data
-	 * \key					CRC key (defined above)
 	 */
-	uint8_t CRC8(uint8_t *input, uint8_t length, uint8_t key)
+	uint8_t CRC8(const uint8_t *input, uint8_t length)
 	{
-		uint8_t crc = 0;
-
-		while(length-- != 0)
-		{
-			for (uint8_t i=0x80; i!=0; i/=2)
-			{
-				if ((crc & 0x80) != 0)
-				{
-					crc *= 2;
-					crc ^= key;
-				}
-				else
-				{
-					crc *= 2;
-				}
-
-				if ((*input & i) != 0)
-				{
-					crc ^= key;
-				}
-			}
-
-			input++;
-		}
-
-		return crc;
+		return crc8::compute<CRC_KEY>(input, length);
 	}
 };
 
+/*
+ * AFE of this BMS (variant and cell inputs from configuration.hpp)
+ */
+typedef BQ769x0<bms_config::afe_variant, bms_config::cell_taps> BQ76930;
+
+/*
+ * Serves the ALERT pin interrupt for the AFE set up by init_alert()
+ * (called by the port 0 pin interrupt handler, see bms_events.cpp)
+ */
+void afe_alert_interrupt(void);
+
 #endif /* BQ76930_HPP_ */
@@ -22,53 +22,121 @@
 #include "pins.hpp"
 #include "BQ76930.hpp"
 #include "bms_state.hpp"
+#include "thermistor.hpp"
+#include "fixed_point.hpp"
 #include <cmath>
 
 /* LSB of ADC conversion (µV) */
 #define LSB						3223
+/* Number of ADC channels (AD0..AD7) */
+#define ADC_CHANNELS			8
+/* Decimated current windows buffered between two measure_current() calls (power of 2) */
+#define CURRENT_WINDOWS			4
 
 namespace adc
 {
 	/* Temperatures array (based on number of temperature sensors of the BMS) */
 	extern int16_t temperature_readings[bms_config::n_temperature_sensors];
-	/* Current measurement readout */
+	/* Current measurement readout (average over the latest window, mA) */
 	extern int16_t current_sense;
-	/* Temperatures samples not in range, one for each sensor (counters) */
-	extern int temperature_counters[bms_config::n_temperature_sensors];
+	/* Sample with the largest magnitude (mA, signed) and RMS current (mA) over the same windows */
+	extern int16_t current_peak;
+	extern int16_t current_rms;
+	/* Decimated windows lost because measure_current() wasn't called in time */
+	extern uint16_t current_overruns;
+	/* Zero offset of the current measurement (mA), and whether it comes from a valid calibration */
+	extern int16_t current_offset;
+	extern bool current_calibrated;
+	/* Rate of rise of the filtered temperatures (1/16 °C/min), one for each sensor */
+	extern int16_t temperature_rates[bms_config::n_temperature_sensors];
+	/* Thermal runaway warning, one bit for each sensor (see measure_temperature) */
+	extern uint8_t thermal_runaway;
+	/* Filtered temperatures over OT/UT limits, one for each sensor (counters) */
+	extern int overtemperature_counters[bms_config::n_temperature_sensors];
+	extern int undertemperature_counters[bms_config::n_temperature_sensors];
 	/*
 	 * Initializes the ADC pins and the peripheral
 	 */
 	void init_adc();
 
 	/*
-	 * Read ADC data from channel adc_channel [ADC0..ADC7]
-	 *
-	 * "Blocking" function: gets stuck in the while loop up until
-	 * the A/D conversion is done, then reads the digital result
+	 * Starts the sampling timer (CT32B1): a scan of all the analog inputs is started every
+	 * 1 / bms_config::current_sample_rate, and every Current_Amp sample is fed into the
+	 * decimator (see measure_current).
+	 */
+	void init_sampling();
+
+	/*
+	 * Stops the sampling timer (before entering deep sleep)
+	 */
+	void stop_sampling();
+
+	/*
+	 * Starts a scan of all the analog inputs in use (Temp0..2 and Current_Amp).
+	 * The channels are converted back to back in burst mode and the scan is completed
+	 * by the ADC interrupt (ADC_IRQHandler), so this returns immediately.
+	 * A scan takes a few µs; calling it while the previous one is still running does nothing.
+	 */
+	void start_scan();
+
+	/*
+	 * Results of the last completed scan, indexed by channel (ADC_CH0..ADC_CH7).
+	 * The samples are double buffered: the buffer returned here is not touched by the
+	 * interrupt until the next start_scan(), so all the channels read from it belong
+	 * to the same scan.
 	 */
-	uint16_t read(ADC_CHANNEL_T adc_channel);
+	const volatile uint16_t *samples();
+
+	/*
+	 * Completes the running scan (called by ADC_IRQHandler)
+	 */
+	void scan_handler();
 
 	/*
 	 * This function measures the current flowing in the Sense- and Sense+
 	 * pins, connected directly to the MCU from the cells.
 	 * The measured current is the one flowing through the PCB.
+	 *
+	 * Current_Amp is sampled by the timer at bms_config::current_sample_rate and decimated
+	 * (moving average) over windows of bms_config::current_window samples. current_sense and
+	 * current_rms come from the latest completed window, current_peak from all the windows
+	 * completed since the last call; they're left untouched if no window has been completed
+	 * meanwhile. Conversions are multiply and shift only (see fixed_point.hpp).
 	 */
 	void measure_current();
 
+	/*
+	 * Measures the zero offset of the current measurement: the mean current over
+	 * bms_config::current_calibration_windows windows is taken as the offset, so it has
+	 * to be called with the FETs open (no current flowing), after init_adc().
+	 * Offsets beyond bms_config::current_offset_limit are rejected (current_calibrated
+	 * stays FALSE) and the nominal 1.8V zero is used instead.
+	 *
+	 * Afterwards, measure_current() subtracts the offset plus a per-state correction and
+	 * tracks its drift while the current is at rest (READY and BALANCING states only).
+	 * The offset is kept through deep sleep.
+	 */
+	void calibrate_current();
+
 	/*
 	 * This function measures the temperature from the three thermistors.
 	 * (Temp0, Temp1, Temp2)
 	 * If the temperature exceeds the maximum required it triggers an OVERTEMPERATURE error
 	 * and opens the DSG MOSFET.
 	 *
-	 * The measured temperatures are stored in the array defined above.
+	 * Every reading goes through a median filter (spikes) and an IIR filter (noise), and
+	 * only the filtered temperature is checked and stored in the array defined above.
+	 * Every bms_config::temperature_rate_period the rate of rise of each sensor is updated:
+	 * above bms_config::temperature_rate_max for bms_config::temperature_rate_count periods
+	 * in a row, the sensor bit of thermal_runaway is set (it's cleared as soon as the rate
+	 * drops). The warning doesn't change the BMS state.
 	 */
 	void measure_temperature();
 
 	/*
 	 * Check that temperature measurements are in the permitted range.
 	 * If error syndrome persists (OT, UT) for any given sensor,
-	 * disconnect LVB.
+	 * disconnect LVB. Every reading back in range decreases the counter of the syndrome.
 	 */
 	void check(int sensor, int16_t temperature);
 }
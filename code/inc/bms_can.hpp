@@ -26,10 +26,20 @@
 #include "bms.hpp"
 #include "pins.hpp"
 
+/* Message objects used for transmission (after the reception one, object 1): the first one
+ * for the fault frames, the others for the telemetry */
+#define CAN_TX_FIRST_OBJECT		2
+#define CAN_TX_OBJECTS			4
+/* Frames waiting for a free message object, for each priority (power of 2) */
+#define CAN_TX_QUEUE_SIZE		8
+/* Received frames waiting for the main loop (power of 2) */
+#define CAN_RX_QUEUE_SIZE		8
+
 namespace can
 {
 	/*
-	 * CAN message structure
+	 * CAN message structure, also the record of the reception and transmission queues
+	 * (12 bytes instead of the 20 of a CCAN_MSG_OBJ)
 	 */
 	struct message
 	{
@@ -38,13 +48,33 @@ namespace can
 		uint8_t length;
 	};
 	/*
-	 * Initialize the CAN peripheral
+	 * Transmission priorities: the fault frames have their own message object, the lowest
+	 * numbered, so the controller sends them ahead of the telemetry already loaded. The
+	 * telemetry frames keep the order they were sent in.
+	 */
+	enum priority : uint8_t
+	{
+		PRIORITY_FAULT,			//State changes and faults
+		PRIORITY_TELEMETRY,		//Periodic telemetry
+
+		N_PRIORITIES
+	};
+	/*
+	 * Transmission queues statistics, for each priority: frames dropped because the queue
+	 * was full, and largest number of frames waiting in it
+	 */
+	extern uint16_t tx_dropped[N_PRIORITIES];
+	extern uint8_t tx_high_water[N_PRIORITIES];
+	/*
+	 * Initialize the CAN peripheral (transmission queues emptied)
 	 */
 	void init_can();
 	/*
-	 * Send a message over the CAN bus
+	 * Send a message over the CAN bus, without waiting: the frame goes to a free message
+	 * object right away, or waits in the queue of its priority, refilled by the transmission
+	 * interrupt. FALSE (frame dropped) if the queue is full.
 	 */
-	void send(message *msg);
+	bool send(const message *msg, priority level = PRIORITY_TELEMETRY);
 	/*
 	 * Receive a message from the CAN bus
 	 * It's going to be used by the BMS for ACK reception
@@ -0,0 +1,71 @@
+/*
+ * bms_charge.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the charge controller of the LVB.
+ *
+ * The charger (Delta) regulates the current by itself: the BMS follows the charging
+ * procedure, publishes the current the pack can take and opens the FETs when the charger
+ * doesn't respect it. The limit reaches the charger through the CHARGE telemetry frame
+ * (telemetry.hpp). The controller is a state machine stepped by a scheduler task, so
+ * the rest of the monitoring keeps running during the charge.
+ *
+ * IDLE					Not charging, waiting for the charging conditions (READY, LVB below
+ *						bms_config::voltage_setpoint, current below charge_enable_threshold)
+ * PENDING				Conditions holding, charging starts after bms_config::charging_debounce
+ * CONSTANT_CURRENT		Charging (CHARGE state), until a cell reaches charge_cv_voltage
+ * CONSTANT_VOLTAGE		Charging, until the current tapers off below charge_stop_threshold
+ * PAUSED				FETs opened: temperature outside the charging range, or charge current
+ *						over the limit. Charging resumes when the limit is back above the current
+ *						drawn when pausing, and ends after bms_config::charge_max_pauses pauses or
+ *						a pause of bms_config::charge_pause_timeout
+ *
+ * Charging ends (back to READY) when the current stops flowing, and it's aborted when an
+ * error state takes over.
+ *
+ * Charge current limit, from the temperatures (°C):
+ *
+ *	 full  |       ____________________
+ *	       |      /                    \
+ *	   0   |_____/                      \_____
+ *	         temperature_min  low     charging_high  charging_max
+ */
+
+#ifndef BMS_CHARGE_HPP_
+#define BMS_CHARGE_HPP_
+
+#include "chip.h"
+
+namespace charge
+{
+	enum phase_t : uint8_t
+	{
+		IDLE,
+		PENDING,
+		CONSTANT_CURRENT,
+		CONSTANT_VOLTAGE,
+		PAUSED
+	};
+
+	/* Current phase of the procedure */
+	extern phase_t phase;
+	/* Charge current the pack can take at the measured temperatures (mA, positive) */
+	extern uint16_t current_limit;
+	/* Times the charge has been paused because of the current limit */
+	extern uint16_t limit_pauses;
+
+	/*
+	 * Back to IDLE, without touching states or FETs (after the wakeup)
+	 */
+	void reset();
+
+	/*
+	 * Steps the procedure, every bms_config::charge_period ms
+	 */
+	void step();
+}
+
+#endif /* BMS_CHARGE_HPP_ */
@@ -0,0 +1,61 @@
+/*
+ * bms_events.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the event queue driving the main loop.
+ *
+ * Interrupt handlers post an event whenever something changes (task due, pin edges,
+ * I2C transaction done, CAN frame received) and the main loop serves
+ * them one by one, sleeping in __WFI while the queue is empty.
+ *
+ * Events carry no data, the handlers read the state of the source: an event already
+ * waiting in the queue isn't queued twice, so the queue can't overflow and a slow
+ * handler only merges the events of the same kind.
+ */
+
+#ifndef BMS_EVENTS_HPP_
+#define BMS_EVENTS_HPP_
+
+#include "chip.h"
+
+/*
+ * Queue length (power of 2, at least the number of events)
+ */
+#define EVENT_QUEUE_SIZE	8
+
+namespace events
+{
+	enum event_t : uint8_t
+	{
+		TICK,			//Scheduler task due (SysTick, see bms_scheduler.hpp)
+		ALERT,			//AFE ALERT pin raised (port 0 pin interrupt)
+		BUTTON,			//Wakeup button pressed (port 0 pin interrupt)
+		SENSE,			//LVB sense pins changed (port 0 pin interrupt)
+		I2C_DONE,		//I2C transaction completed (I2C interrupt)
+		CAN_RX,			//CAN frame received (CAN interrupt)
+
+		N_EVENTS
+	};
+
+	/*
+	 * Starts the pin interrupts of the wakeup button and of the sense pins (both edges).
+	 * The ticks come from the scheduler (see scheduler::init).
+	 * A SENSE event is posted right away, so the sense pins are evaluated once.
+	 */
+	void init();
+
+	/*
+	 * Queues an event (safe from any interrupt priority)
+	 */
+	void post(event_t event);
+
+	/*
+	 * Returns the oldest queued event, sleeping (__WFI) until one is posted
+	 */
+	event_t wait();
+}
+
+#endif /* BMS_EVENTS_HPP_ */
@@ -81,6 +81,51 @@ namespace gpio
 		return {port, pin};
 	}
 
+	/*
+	 * Enables the edge interrupt of an input pin (rising edge if \rising, falling edge otherwise).
+	 * The interrupt is served by the PIOINTx_IRQHandler of the pin's port.
+	 */
+	inline void enable_interrupt(pin input, bool rising)
+	{
+		Chip_GPIO_SetPinModeEdge(LPC_GPIO, input.port, 1 << input.pin);
+		Chip_GPIO_SetEdgeModeSingle(LPC_GPIO, input.port, 1 << input.pin);
+		if (rising)
+		{
+			Chip_GPIO_SetModeHigh(LPC_GPIO, input.port, 1 << input.pin);
+		}
+		else
+		{
+			Chip_GPIO_SetModeLow(LPC_GPIO, input.port, 1 << input.pin);
+		}
+		Chip_GPIO_ClearInts(LPC_GPIO, input.port, 1 << input.pin);
+		Chip_GPIO_EnableInt(LPC_GPIO, input.port, 1 << input.pin);
+	}
+
+	/*
+	 * Enables the interrupt of an input pin on both edges
+	 * (served by the PIOINTx_IRQHandler of the pin's port, as above)
+	 */
+	inline void enable_interrupt_edges(pin input)
+	{
+		Chip_GPIO_SetPinModeEdge(LPC_GPIO, input.port, 1 << input.pin);
+		Chip_GPIO_SetEdgeModeBoth(LPC_GPIO, input.port, 1 << input.pin);
+		Chip_GPIO_ClearInts(LPC_GPIO, input.port, 1 << input.pin);
+		Chip_GPIO_EnableInt(LPC_GPIO, input.port, 1 << input.pin);
+	}
+
+	/*
+	 * Returns TRUE (and clears it) if the pin interrupt is pending
+	 */
+	inline bool clear_interrupt(pin input)
+	{
+		if (Chip_GPIO_GetMaskedInts(LPC_GPIO, input.port) & (1 << input.pin))
+		{
+			Chip_GPIO_ClearInts(LPC_GPIO, input.port, 1 << input.pin);
+			return true;
+		}
+		return false;
+	}
+
 	/*
 	 * Get the status of a pin.
 	 * TRUE if pin is HIGH, FALSE otherwise
@@ -35,9 +35,47 @@
  *
  */
 #define I2C_SPEED		100000
+/*
+ * Maximum number of transactions waiting in the asynchronous queue
+ * (power of 2, the queue index is masked instead of divided)
+ */
+#define I2C_QUEUE_SIZE	8
+/*
+ * Number of restarts of a transaction upon arbitration loss
+ * before giving up (same meaning of I2C_FAIL_TIMEOUT in the LPC library)
+ */
+#define I2C_MAX_RETRIES	16
 
 namespace i2c
 {
+	/*
+	 * Asynchronous transaction descriptor.
+	 *
+	 * Fill in the address and the two buffers (leave size 0 for the unused direction),
+	 * then submit() it: the I2C interrupt handler moves the transaction forward and, once
+	 * the STOP condition has been sent, sets \done and calls \callback (if any) from
+	 * the interrupt context.
+	 *
+	 * The descriptor and its buffers must stay valid until \done is set.
+	 * \sent and \received report how many bytes actually went through the bus.
+	 */
+	struct transaction
+	{
+		uint8_t address;
+		const uint8_t *send_data;
+		size_t send_size;
+		uint8_t *receive_data;
+		size_t receive_size;
+		void (*callback)(transaction *t);
+
+		/* Filled in by the transaction engine */
+		I2C_XFER_T xfer;
+		uint8_t retries;
+		size_t sent;
+		size_t received;
+		volatile I2C_STATUS_T status;
+		volatile bool done;
+	};
 	/*
 	 * Initializes the I2C bus and the master (board) pins
 	 *
@@ -50,7 +88,11 @@ namespace i2c
 	 */
 	void set_intr(I2C_ID_T id);
 	/*
-	 * Master send
+	 * Master send.
+	 *
+	 * The blocking operations below are built on top of the asynchronous queue:
+	 * they submit a transaction and wait for it, so they can be freely mixed with
+	 * submit() calls.
 	 */
 	int send(I2C_ID_T id, uint8_t address, size_t send_size, uint8_t send_data[]);
 	/*
@@ -70,6 +112,24 @@ namespace i2c
 	 * Useful in case of repeated start
 	 */
 	int command_read(I2C_ID_T id, uint8_t address, uint8_t command, size_t size, uint8_t data[]);
+	/*
+	 * Queues a transaction on the bus and returns immediately.
+	 * Returns false (and leaves the transaction untouched) if the queue is full.
+	 */
+	bool submit(transaction *t);
+	/*
+	 * Busy waits until the transaction has been completed by the interrupt handler.
+	 * Returns the final status of the transaction.
+	 */
+	I2C_STATUS_T wait(transaction *t);
+	/*
+	 * TRUE when no transaction is in progress nor waiting in the queue
+	 */
+	bool is_idle();
+	/*
+	 * Moves the current transaction forward (called by I2C_IRQHandler)
+	 */
+	void state_handler();
 }
 
 
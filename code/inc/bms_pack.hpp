@@ -0,0 +1,168 @@
+/*
+ * bms_pack.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the pack-level view of the AFEs of the LVB.
+ *
+ * Larger packs are built stacking bms_config::n_afe identical AFEs, each one at its
+ * own I2C address or behind an I2C mux channel (see configuration.hpp).
+ * BMS_pack drives all of them and exposes the same interface of a single AFE to the
+ * rest of the program: one cell array (cells of AFE 0 first), pack min/max/avg
+ * voltages, the pack voltage and a single fault summary for state::status_encoder().
+ *
+ * The first AFE is the bottom of the stack: it's the only one measuring the pack
+ * current, so state of charge and ALERT acquisition come from it.
+ */
+
+#ifndef BMS_PACK_HPP_
+#define BMS_PACK_HPP_
+
+#include "chip.h"
+#include "BQ76930.hpp"
+#include "configuration.hpp"
+
+class BMS_pack
+{
+private:
+
+	/* Last SYS_STAT read out of every AFE (see read_status) */
+	uint8_t afe_status[bms_config::n_afe] = {0};
+
+	/*
+	 * Collects the error bits of all the AFEs
+	 */
+	void update_error(void)
+	{
+		for (int i=0; i<bms_config::n_afe; ++i)
+		{
+			error_bit |= afe[i].error_bit;
+		}
+	}
+
+	/*
+	 * Pack minimum, maximum and average cell voltage
+	 */
+	void statistics(void);
+
+	/*
+	 * TRUE if every cell of the pack is within bms_config::balancing_stop of the minimum
+	 */
+	bool balancing_stop_condition(void);
+
+public:
+
+	/* AFEs of the pack, from the bottom of the stack */
+	BQ76930 afe[bms_config::n_afe];
+
+	/*
+	 * Cell voltages of the whole pack (mV), and pack voltage (mV) as the sum of the
+	 * battery voltage of every AFE.
+	 */
+	uint16_t voltage_readings[bms_config::pack_cells] 	= {0};
+	uint32_t battery_voltage 							= 0;
+	/*
+	 * State of charge (0.1%) and current (mA), from the coulomb counter of the first AFE
+	 */
+	int16_t state_of_charge 							= 0;
+	int16_t cc_current 									= 0;
+
+	/*
+	 * ERROR BIT
+	 * Set as soon as one of the AFEs reports a communication error
+	 */
+	bool error_bit 										= false;
+
+	/*
+	 * BALANCING ENABLED
+	 * Same meaning of BQ769x0::balancing_enabled, for the whole pack
+	 */
+	bool balancing_enabled 								= false;
+
+	/*
+	 * Minimum, Maximum and Average cell voltage of the whole pack
+	 */
+	uint16_t min_voltage								= 0;
+	uint16_t max_voltage								= 0;
+	uint16_t avg_voltage								= 0;
+
+	/*
+	 * Same values of the single AFE ones (see BQ76930.hpp)
+	 */
+	const uint8_t FET_DISABLE	= 0x00;
+	const uint8_t FET_ON		= 0x03;
+	const uint8_t CC_READY		= 0x80;
+
+	/*
+	 * Initializes the I2C bus, and every AFE with its own I2C address and mux channel
+	 */
+	void init(void);
+	/*
+	 * ALERT acquisition, served by the first AFE (the only one wired to the ALERT pin).
+	 * The other AFEs are read out at the same time.
+	 */
+	void init_alert(void)
+	{
+		afe[0].init_alert();
+	}
+	bool alert_pending(void)
+	{
+		return afe[0].alert_pending();
+	}
+	/*
+	 * Reads SYS_STAT of every AFE and returns the OR of them (pack fault summary).
+	 */
+	uint8_t read_status(void);
+	/*
+	 * Queues the cell voltages block read of every AFE at once, so the transactions are
+	 * served back to back by the I2C queue (see BQ769x0::start_cellvoltages).
+	 */
+	void start_cellvoltages(void);
+	/*
+	 * TRUE once the block reads queued by start_cellvoltages() have completed on every AFE
+	 */
+	bool cellvoltages_done(void);
+	/*
+	 * Completes the cell voltages read of every AFE and updates the pack cell array
+	 * and statistics.
+	 */
+	void read_cellvoltages(void);
+	/*
+	 * Reads the battery voltage of every AFE and sums them up
+	 */
+	void read_battery_voltage(void);
+	/*
+	 * State of charge of the pack, integrated by the first AFE (see BQ769x0)
+	 */
+	void init_stateofcharge(uint16_t capacity, int16_t initial_soc);
+	/*
+	 * Integrates the coulomb counter of the first AFE, only if its last SYS_STAT
+	 * reported CC_READY (the others raise it too, on their own schedule)
+	 */
+	void read_stateofcharge(void);
+	/*
+	 * Balancing of the whole pack: every AFE balances its own cells against the
+	 * minimum voltage of the pack, and balancing stops when all the pack cells are
+	 * close enough to it.
+	 */
+	void check_balancing(bool activate = true);
+	/*
+	 * Clears the SYS_STAT bits (within mask) of every AFE, each one with the bits it reported
+	 * at the last read_status(): SYS_STAT is write-1-to-clear, so writing the pack summary
+	 * to all of them would drop faults latched by an AFE after the read
+	 */
+	void clear_status(uint8_t mask = 0xFF);
+	/*
+	 * Same register written on every AFE (i.e. FETs)
+	 */
+	void write_register(const TI_Register_ID reg, uint8_t data, bool force = false);
+	void invalidate_register(const TI_Register_ID reg);
+	/*
+	 * Configuration registers readback of every AFE (see BQ769x0::check_registers)
+	 */
+	void check_registers(void);
+};
+
+#endif /* BMS_PACK_HPP_ */
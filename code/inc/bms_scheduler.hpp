@@ -0,0 +1,80 @@
+/*
+ * bms_scheduler.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the time-triggered cooperative scheduler of the periodic work.
+ *
+ * SysTick counts milliseconds and posts events::TICK only when a task is due. Every task
+ * is released at phase + k x period (ms), always computed from the previous release, so
+ * the periods don't drift however long the tasks take. Due tasks run to completion in
+ * table order: the release jitter of a task is bounded by the budgets of the tasks before
+ * it in the table (plus the other events served by the main loop), and tasks sharing a
+ * period are kept apart by their phases.
+ *
+ * Every task is timed with the SysTick counter (core clock cycles). A run longer than its
+ * budget is an overrun, and a release found already a whole period late is skipped (the
+ * task runs once and keeps its phase). Both counters saturate.
+ */
+
+#ifndef BMS_SCHEDULER_HPP_
+#define BMS_SCHEDULER_HPP_
+
+#include "chip.h"
+
+namespace scheduler
+{
+	struct task
+	{
+		void (*run)(void);
+
+		/* Release period and offset of the first release (ms), time budget of a run (us) */
+		uint16_t period;
+		uint16_t phase;
+		uint16_t budget;
+
+		/* Run-time statistics, kept by the scheduler */
+		uint32_t release;			//Next release (ms)
+		uint32_t budget_cycles;		//Budget in core clock cycles
+		uint32_t worst;				//Longest run (core clock cycles)
+		uint16_t overruns;			//Runs longer than the budget
+		uint16_t skipped;			//Releases missed because the task was late
+	};
+
+	/*
+	 * Starts the scheduler on the task table (first releases at the task phases) and the
+	 * 1ms SysTick interrupt. The table must outlive the scheduler.
+	 */
+	void init(task *table, int n_tasks);
+
+	/*
+	 * Restarts the SysTick interrupt (after the deep sleep), the releases carry on from the
+	 * time it was stopped
+	 */
+	void start();
+
+	/*
+	 * Milliseconds since init() (wraps after 49 days, compare differences only)
+	 */
+	uint32_t now();
+
+	/*
+	 * Runs the due tasks, called by the main loop on events::TICK
+	 */
+	void run();
+
+	/*
+	 * Task table given to init() and its length, for the statistics (overruns, skipped)
+	 */
+	const task *table();
+	int size();
+
+	/*
+	 * Longest run of a task (us)
+	 */
+	uint32_t worst_time(const task &t);
+}
+
+#endif /* BMS_SCHEDULER_HPP_ */
@@ -14,9 +14,11 @@
 #include "pmu_11xx.h"
 #include "cmsis.h"
 #include "BQ76930.hpp"
+#include "bms_pack.hpp"
 #include "pins.hpp"
 #include "bms_adc.hpp"
 #include "bms_can.hpp"
+#include "bms_events.hpp"
 /*
  * This header contains the definition of the BMS states
  * It's used runtime to discriminate between different operation
@@ -49,7 +51,10 @@
  * The error syndromes are encoded as the ones read out directly from the AFE (see BQ76930.hpp/.cpp
  * for further details), that's the reason for this placement.
  *
- * ALL ERROR STATES ARE UNRECOVERABLE FOR THE BMS (LVB DISCONNECT)
+ * UV, OT, UT AND ILLEGAL_STATE ARE UNRECOVERABLE FOR THE BMS (LVB DISCONNECT): they only
+ * lead to each other or to SLEEP, and the AFE errors read meanwhile don't replace them.
+ * The other AFE errors go back to READY once they stop persisting (see the transition
+ * matrix in bms_state.cpp). Every state can go to SLEEP.
  *
  */
 enum state_t : uint8_t
@@ -94,18 +99,18 @@ enum state_t : uint8_t
 extern state_t bms_state;
 
 /*
- * AFE Class object.
+ * AFEs of the pack (see bms_pack.hpp).
  * Declared here and used anywhere in the code (defined in bms.cpp)
  */
-extern BQ76930 monitor;
+extern BMS_pack monitor;
 /*
  * Added small check for AFE FET closing
  */
 extern bool check;
 /*
- * "Software Timer" to enter deep sleep when the LVB is disconnected
+ * Time (ms) the LVB has been found disconnected at, deep sleep follows after the timeout
  */
-extern uint32_t deep_sleep_timer;
+extern uint32_t disconnected_at;
 /*
  * Sanity check used to stop above timer whenever LVB is connected again
  */
@@ -115,58 +120,27 @@ extern bool lvb_sense;
  */
 extern bool in_charge;
 /*
- * Enables CAN messages to be sent at a pre-determined rate (avoids bus overflow)
+ * Time (ms) of the last wakeup or balancing activation: debounces balancing procedure and
+ * wakeup interrupt handler (both use Button1 to be enabled)
  */
-extern int can_update_counter;
-/*
- * Debounces balancing procedure and wakeup interrupt handler (both use Button1 to be enabled)
- */
-extern int balancing_enabling_count;
-/*
- * Counter that calls balancing update according to the timeout
- */
-extern int balancing_enabler;
-/*
- * Counter that enables de-bouncing of the charging procedure
- */
-extern int charging_enabling_count;
+extern uint32_t button_pressed_at;
 
 namespace state
 {
 	/*
-	 * State transition structure (comprises an old state and a new one)
+	 * TRUE if the state machine allows going from old_state to new_state.
+	 * The transitions are a constant matrix (see bms_state.cpp), so this is a single lookup.
+	 * Staying in the same state is always allowed.
 	 */
-	struct state_transition
-	{
-		state_t old_;
-		state_t new_;
-	};
+	bool is_valid_transition(state_t old_state, state_t new_state);
+
 	/*
-	 * Valid state transitions.
-	 * It's used to avoid messing up with the state machine
+	 * Moves bms_state to new_state, running the exit action of the old state and the entry
+	 * action of the new one (LEDs and FETs, declared in the transition table).
+	 * Setting the current state again re-applies its entry action only.
+	 * A transition not allowed by the table sets ILLEGAL_STATE, without actions.
 	 */
-	extern state_transition valid_state_transitions[10	];
-
-	inline bool is_valid_transition(state_t old_state, state_t new_state)
-	{
-		for (uint8_t i=0; i<sizeof(valid_state_transitions); i++)
-		{
-			if ((valid_state_transitions[i].old_ == old_state) && (valid_state_transitions[i].new_ = new_state))
-			{
-				return true;
-			}
-		}
-		return false;
-	}
-
-	inline void set_state(state_t new_state)
-	{
-		if (is_valid_transition(bms_state, new_state))
-		{
-			bms_state = new_state;
-		}
-		else bms_state = ILLEGAL_STATE;
-	}
+	void set_state(state_t new_state);
 	/*
 	 * This function encodes the SYS_STAT register output into readable and
 	 * understandable error codes.
@@ -176,6 +150,11 @@ namespace state
 	 * \param monitor	Instance of the BQ76930 class (declared in bms.cpp)
 	 */
 	void status_encoder();
+	/*
+	 * Same as above, but encodes a SYS_STAT value that has already been read out
+	 * (i.e. when serving the ALERT pin)
+	 */
+	void status_encoder(uint8_t status);
 	/*
 	 * PMU initialization and required steps to set up the DEEP SLEEP mode
 	 * defined in the LPC11Cxx user manual.
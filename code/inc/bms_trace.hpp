@@ -0,0 +1,87 @@
+/*
+ * bms_trace.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the binary trace of the periodic measurements, replacing the
+ * RTTOUT (SEGGER_RTT_printf) calls of the main loop.
+ *
+ * Every log site is a message of trace_messages.hpp, whose ID is known at compile time:
+ * only the ID, the time and the raw integer arguments are written (a few bytes, see the
+ * stream layout there) to the RTT up-buffer TRACE_CHANNEL, and the host decoder turns
+ * them back into text. No formatting happens on the target.
+ *
+ * Records are first queued (TRACE_QUEUE_SIZE bytes, see spsc_ring.hpp), so logging is a
+ * short copy whatever the state of the host, and flush() moves them to the up-buffer
+ * when the main loop is idle. A record that doesn't fit in the queue (host not reading
+ * fast enough) is dropped as a whole, so the stream always stays in sync: the number of
+ * records lost is reported by the next TRACE_DROPPED record.
+ *
+ * Main loop only: the queue has a single producer, and RTT isn't locked against the
+ * interrupts (see SEGGER_RTT_Conf.h).
+ * Text output (RTTOUT, channel 0) is left to the boot and to the rare events.
+ */
+
+#ifndef BMS_TRACE_HPP_
+#define BMS_TRACE_HPP_
+
+#include "chip.h"
+#include "trace_messages.hpp"
+
+/* RTT up-buffer of the trace, its size, and the size of the queue (power of 2) */
+#define TRACE_CHANNEL		1
+#define TRACE_BUFFER_SIZE	512
+#define TRACE_QUEUE_SIZE	512
+
+namespace trace
+{
+	#define TRACE_ID(name, format, arguments)			name,
+	#define TRACE_ARGUMENTS(name, format, arguments)	arguments,
+
+	enum id_t : uint8_t
+	{
+		TRACE_MESSAGES(TRACE_ID)
+
+		N_MESSAGES
+	};
+
+	/* Number of arguments of every message */
+	constexpr uint8_t arguments[] = { TRACE_MESSAGES(TRACE_ARGUMENTS) };
+
+	#undef TRACE_ID
+	#undef TRACE_ARGUMENTS
+
+	/* Records dropped since the last TRACE_DROPPED record */
+	extern uint32_t dropped;
+
+	/*
+	 * Configures the trace up-buffer and writes TRACE_START
+	 */
+	void init();
+
+	/*
+	 * Queues a record (use log() instead, it checks the arguments at compile time)
+	 */
+	void write(id_t id, const int32_t *values, int n_values);
+
+	/*
+	 * Copies the queued records to the up-buffer, as much as the host left room for
+	 */
+	void flush();
+
+	/*
+	 * Writes message ID with its arguments
+	 */
+	template<id_t ID, typename... ARGS>
+	inline void log(ARGS... args)
+	{
+		static_assert(sizeof...(ARGS) == arguments[ID], "Wrong number of trace arguments");
+
+		const int32_t values[sizeof...(ARGS) + 1] = { int32_t(args)..., 0 };
+		write(ID, values, int(sizeof...(ARGS)));
+	}
+}
+
+#endif /* BMS_TRACE_HPP_ */
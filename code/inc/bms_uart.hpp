@@ -15,43 +15,40 @@
 
 #include "chip.h"
 #include "uart_11xx.h"
-#include "ring_buffer.h"
 
 #include "stdio.h"
 #include "string.h"
 
 namespace uart
 {
-	/* Transmit and Receive ring buffers */
-	extern RINGBUFF_T send_buffer;
-	extern RINGBUFF_T recv_buffer;
-
-	/* Size of the two ring buffers */
+	/* Size of the two FIFO queues (power of 2) */
 	const int send_fifo_size	= 128;
 	const int recv_fifo_size	= 32;
 
-	/* Transmit and Receive buffers associated with the ring buffers */
-	extern uint16_t tx_buffer[send_fifo_size];
-	extern uint16_t rx_buffer[recv_fifo_size];
+	/* Bytes received and lost because the receive queue was full */
+	extern uint16_t recv_dropped;
 
 	/*
-	 * Initializes UART peripheral and pins, as well as the two ring buffers used as FIFO queues
+	 * Initializes UART peripheral and pins, as well as the two FIFO queues
 	 */
 	void init();
 
 	/*
-	 * Sends a message over UART
+	 * Sends a message over UART, without waiting: the bytes are queued and transmitted by
+	 * the interrupt
 	 *
 	 * \parameters
 	 * tx_data		buffer to be sent via UART
 	 * length		length of the buffer
+	 *
+	 * FALSE (nothing sent) if the whole message doesn't fit in the queue
 	 */
-	void send(uint16_t *tx_data, int length);
+	bool send(const uint8_t *tx_data, int length);
 
 	/*
-	 * Receives a message over UART
+	 * Receives up to \length bytes over UART, returns the number of bytes read
 	 */
-	void receive();
+	int receive(uint8_t *rx_data, int length);
 }
 
 
@@ -0,0 +1,184 @@
+/*
+ * bq769x0.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header describes the bq769x0 family of Analog Front Ends (bq76920, bq76930
+ * and bq76940) and generates, at compile time, the cell map of a pack from the chip
+ * variant and the populated cell inputs (taps).
+ *
+ * For every connected cell the map holds:
+ * tap					VCx input of the cell (0 = VC1), that gives the position of its
+ *						VCx_HI/VCx_LO registers in the cell voltages block
+ * group				CELLBAL register driving the cell (0 = CELLBAL1), one every 5 inputs
+ * bit					bit of the cell in its CELLBAL register
+ * conflicts			cells that can't be balanced together with it (adjacent inputs
+ *						of the same group, by datasheet)
+ *
+ * Unpopulated taps are shorted by HW design and are simply skipped, so cell i is the
+ * i-th connected cell starting from the bottom of the stack.
+ */
+
+#ifndef BQ769X0_HPP_
+#define BQ769X0_HPP_
+
+#include "chip.h"
+
+namespace bq769x0
+{
+	/*
+	 * Chip variants, the value is the number of cell inputs
+	 */
+	enum variant : uint8_t
+	{
+		bq76920		= 5,
+		bq76930		= 10,
+		bq76940		= 15
+	};
+
+	/* Cell inputs handled by each CELLBAL register */
+	constexpr int group_size = 5;
+
+	constexpr int popcount(uint32_t value)
+	{
+		int count = 0;
+
+		for (; value != 0; value &= value - 1)
+		{
+			count++;
+		}
+
+		return count;
+	}
+
+	template<variant V, uint16_t TAPS>
+	struct cell_map
+	{
+		static_assert(TAPS != 0 && (TAPS >> V) == 0, "Cell taps outside of the chip inputs");
+
+		static constexpr int n_cells = popcount(TAPS);
+
+		uint8_t tap[n_cells];
+		uint8_t group[n_cells];
+		uint8_t bit[n_cells];
+		uint16_t conflicts[n_cells];
+
+		constexpr cell_map() : tap{}, group{}, bit{}, conflicts{}
+		{
+			int cell = 0;
+
+			for (int input=0; input<V; ++input)
+			{
+				if (TAPS & (1 << input))
+				{
+					tap[cell] = uint8_t(input);
+					group[cell] = uint8_t(input / group_size);
+					bit[cell] = uint8_t(input % group_size);
+					cell++;
+				}
+			}
+
+			for (int a=0; a<n_cells; ++a)
+			{
+				for (int b=0; b<n_cells; ++b)
+				{
+					if (group[a] == group[b] && (bit[a] + 1 == bit[b] || bit[b] + 1 == bit[a]))
+					{
+						conflicts[a] |= uint16_t(1 << b);
+					}
+				}
+			}
+		}
+
+		/*
+		 * TRUE if the cells (bitmask, bit 0 = cell 0) can be balanced at the same time
+		 */
+		constexpr bool compatible(uint16_t cells) const
+		{
+			for (int cell=0; cell<n_cells; ++cell)
+			{
+				if ((cells & (1 << cell)) && (cells & conflicts[cell])) return false;
+			}
+
+			return true;
+		}
+	};
+
+	/*
+	 * Every non-empty set of at most MAX cells that can be balanced at the same time.
+	 * Sets are enumerated by size (Gosper's hack), so only the candidates are visited
+	 * even on 15 cells packs.
+	 */
+	template<variant V, uint16_t TAPS, int MAX>
+	struct balancing_plans
+	{
+		typedef cell_map<V, TAPS> map_type;
+
+		static constexpr int n_cells = map_type::n_cells;
+		static constexpr int max_cells = MAX < n_cells ? MAX : n_cells;
+
+		static constexpr uint32_t next_set(uint32_t cells)
+		{
+			return (((cells ^ ((cells & -cells) + cells)) >> 2) / (cells & -cells)) | ((cells & -cells) + cells);
+		}
+
+		static constexpr int count()
+		{
+			int count = 0;
+
+			for (int size=1; size<=max_cells; ++size)
+			{
+				for (uint32_t cells=(1UL << size) - 1; cells<(1UL << n_cells); cells=next_set(cells))
+				{
+					if (map_type().compatible(uint16_t(cells))) count++;
+				}
+			}
+
+			return count;
+		}
+
+		static constexpr int size = count();
+
+		uint16_t cells[size];
+
+		constexpr balancing_plans() : cells{}
+		{
+			int plan = 0;
+
+			for (int set_size=1; set_size<=max_cells; ++set_size)
+			{
+				for (uint32_t set=(1UL << set_size) - 1; set<(1UL << n_cells); set=next_set(set))
+				{
+					if (map_type().compatible(uint16_t(set))) cells[plan++] = uint16_t(set);
+				}
+			}
+		}
+	};
+
+	/*
+	 * Compile-time tables of a pack, shared by all the AFE instances with the same layout
+	 */
+	template<variant V, uint16_t TAPS, int MAX>
+	struct layout
+	{
+		static constexpr int n_cells = cell_map<V, TAPS>::n_cells;
+		static constexpr int n_plans = balancing_plans<V, TAPS, MAX>::size;
+
+		/* Cell voltage registers, from VC1_HI up to the last VCx_LO of the chip */
+		static constexpr int cell_registers = 2 * V;
+		/* CELLBAL registers available on the chip */
+		static constexpr int balancing_registers = (V + group_size - 1) / group_size;
+
+		static constexpr cell_map<V, TAPS> cells = cell_map<V, TAPS>();
+		static constexpr balancing_plans<V, TAPS, MAX> plans = balancing_plans<V, TAPS, MAX>();
+	};
+
+	template<variant V, uint16_t TAPS, int MAX>
+	constexpr cell_map<V, TAPS> layout<V, TAPS, MAX>::cells;
+	template<variant V, uint16_t TAPS, int MAX>
+	constexpr balancing_plans<V, TAPS, MAX> layout<V, TAPS, MAX>::plans;
+}
+
+#endif /* BQ769X0_HPP_ */
@@ -19,6 +19,7 @@
 #define CONFIGURATION_HPP_
 
 #include "chip.h"
+#include "bq769x0.hpp"
 
 namespace bms_config
 {
@@ -43,8 +44,8 @@ namespace bms_config
 	constexpr int16_t charging_temperature_max	= 45;
 	constexpr int16_t charging_temperature_high	= 40;
 
-	/* Constant use to maximize precision in MATLAB script */
-	constexpr int temperature_multiplier	= 3;
+	/* Scale of the measured temperatures (1/16 °C fixed point, see thermistor.hpp) */
+	constexpr int temperature_multiplier	= 16;
 
 	/* Number of temperature sensors */
 	constexpr int n_temperature_sensors 	= 3;
@@ -52,8 +53,42 @@ namespace bms_config
 	/* Number of OT/UT readings before triggering error */
 	constexpr int max_wrong_temp			= 3;
 
+	/* Temperature filtering: median of the last temperature_median readings (odd), then
+	 * an IIR filter with a time constant of 2^temperature_filter_shift readings */
+	constexpr int temperature_median		= 5;
+	constexpr int temperature_filter_shift	= 3;
+
+	/* Thermal runaway warning: rate of rise measured every temperature_rate_period (ms),
+	 * raised after temperature_rate_count periods above temperature_rate_max (°C/min) */
+	constexpr uint32_t temperature_rate_period	= 2000;
+	constexpr int16_t temperature_rate_max		= 6;
+	constexpr int temperature_rate_count		= 2;
+
+	/* AFE chip variant */
+	constexpr bq769x0::variant afe_variant	= bq769x0::bq76930;
+
+	/* Populated AFE cell inputs, bit 0 = VC1 (VC4, VC8 and VC9 are shorted by HW design) */
+	constexpr uint16_t cell_taps			= 0x0277;
+
 	/* Number of cells */
-	constexpr int n_cells					= 7;
+	constexpr int n_cells					= bq769x0::popcount(cell_taps);
+
+	/* Number of AFEs in the pack, all with the variant and cell taps above.
+	 * The first one is at the bottom of the stack: it measures the pack current
+	 * (coulomb counter) and drives the ALERT pin */
+	constexpr int n_afe						= 1;
+
+	/* Number of cells of the whole pack */
+	constexpr int pack_cells				= n_afe * n_cells;
+
+	/* I2C address of every AFE */
+	constexpr uint8_t afe_address[n_afe]	= { 0x08 };
+
+	/* I2C mux channel of every AFE (-1 when the AFE is directly on the bus) */
+	constexpr int8_t afe_mux_channel[n_afe]	= { -1 };
+
+	/* I2C address of the mux (only used if an AFE has a mux channel) */
+	constexpr uint8_t i2c_mux_address		= 0x70;
 
 	/* Maximum number of balancing cells (not adjacent!) */
 	constexpr int max_balancing_cells 		= 3;
@@ -61,23 +96,38 @@ namespace bms_config
 	/* Voltage difference between cells that stops balancing operations (mV) */
 	constexpr uint16_t balancing_stop 		= 10;
 
+	/* LVB capacity (mAh), used in the state of charge integration */
+	constexpr uint16_t pack_capacity		= 3000;
+
+	/* Current sampling rate (Hz), every sample is a scan of all the analog inputs */
+	constexpr uint32_t current_sample_rate	= 2000;
+
+	/* Current samples in every decimated value (power of 2): 32 samples = 16ms at 2kHz */
+	constexpr int current_window			= 32;
+
 	/* Sense resistor (mΩ)
 	 * It's used in current sense calculations */
 	constexpr uint16_t sense_resistor		= 2;
 
-	/* Deep-Sleep timeout */
-	constexpr uint32_t deep_sleep_timeout 	= 10000;
+	/* Deep-Sleep timeout, after the LVB disconnection (ms) */
+	constexpr uint32_t deep_sleep_timeout 	= 130000;
 
-	/* CAN update limiter (defines the frequency of the updates */
-	constexpr int can_update_limit			= 20;
+	/* Button-pressing debouncer between wakeup and balancing (ms) */
+	constexpr uint32_t balancing_debounce	= 650;
 
-	/* Button-pressing debouncer between wakeup and balancing */
-	constexpr int balancing_debounce		= 50;
+	/* Current sensor zero offset calibration (see adc::calibrate_current):
+	 * windows averaged at boot with the FETs open, and largest accepted offset (mA) */
+	constexpr int current_calibration_windows	= 16;
+	constexpr int16_t current_offset_limit		= 2000;
 
-	/* Balancing timer */
-	constexpr int balancing_timeout			= 200;
+	/* Zero offset drift tracking: the current is at rest when it stays within current_rest_band
+	 * (mA) of zero for current_rest_windows windows, then the offset follows it with a time
+	 * constant of 2^current_drift_shift windows (16s) */
+	constexpr int16_t current_rest_band		= 50;
+	constexpr int current_rest_windows		= 64;
+	constexpr int current_drift_shift		= 10;
 
-	/* Current offset used to make current measurement more precise when charging (mA) */
+	/* Per-state correction on top of the calibrated zero offset, applied when charging (mA) */
 	constexpr int16_t charge_current_offset	= 1000;
 
 	/* Current value that enable or stops charging the LVB (mA) */
@@ -87,56 +137,44 @@ namespace bms_config
 	constexpr int16_t charge_enable_threshold 	= 100;
 	constexpr int16_t charge_stop_threshold		= -500;
 
-	/* Charging debouncer between subsequent charging activations */
-	constexpr int charging_debounce			= 500;
-
-	/* Cycle time for the main loop (ms) */
-	constexpr int cycle_time				= 13;
-
-	/* Reset count for status encoder functionality */
-	constexpr int reset_count				= 385;
+	/* Charging debouncer: charging conditions holding for this long start charging (ms) */
+	constexpr uint32_t charging_debounce	= 6500;
+
+	/* Charge controller (see bms_charge.hpp): largest charge current (mA, 1C), cell voltage
+	 * starting the constant voltage phase (mV) */
+	constexpr uint16_t charge_current_max	= 3000;
+	constexpr uint16_t charge_cv_voltage	= 4150;
+
+	/* Charge current over the limit (plus margin, mA) for charge_overlimit_time (ms) pauses the
+	 * charge, for charge_pause_time (ms) at least. The charge ends after charge_max_pauses
+	 * pauses, or when a pause lasts charge_pause_timeout (ms) */
+	constexpr uint16_t charge_limit_margin		= 200;
+	constexpr uint32_t charge_overlimit_time	= 2000;
+	constexpr uint32_t charge_pause_time		= 10000;
+	constexpr uint8_t charge_max_pauses			= 3;
+	constexpr uint32_t charge_pause_timeout		= 300000;
+
+	/* Least time an error persists before the status encoder can reset it (ms) */
+	constexpr uint32_t reset_time			= 5000;
+
+	/* AFE data acquisition driven by the ALERT pin (CC_READY every 250ms and faults)
+	 * instead of reading cells, pack voltage and SYS_STAT at every status period */
+	constexpr bool alert_acquisition		= true;
+
+	/* Scheduler task periods (ms, see bms_scheduler.hpp and the task table in main.cpp) */
+	constexpr uint16_t current_period			= 16;
+	constexpr uint16_t status_period			= 50;
+	constexpr uint16_t cell_period				= 250;
+	constexpr uint16_t pack_voltage_period		= 250;
+	constexpr uint16_t temperature_period		= 20;
+	constexpr uint16_t can_update_period		= 250;
+	constexpr uint16_t balancing_period			= 2600;
+	constexpr uint16_t supervisor_period		= 10;
+	constexpr uint16_t charge_period			= 100;
+
+	/* AFE configuration registers readback period (ms) */
+	constexpr uint16_t register_verify_period	= 1000;
 }
 
-/* Lookup Table size */
-const int lookup_size = 1024;
-
-/* Lookup Table for the thermistor values.
- * It's used in the temperature measurements, since there's no FP unit in the MCU.
- * The array is created using a MATLAB script and this is the result */
-const int16_t thermistor_lookup_table[lookup_size] = {1800,1425,1131,990,903,843,795,756,723,696,675,654,636,618,603,591,576,567,555,546,537,528,519,510,504,495,
-													489,483,477,471,465,459,456,450,444,441,435,432,426,423,420,417,411,408,405,402,399,396,393,390,387,384,381,378,
-													375,372,369,366,363,360,360,357,354,351,351,348,345,342,342,339,336,336,333,330,330,327,327,324,321,321,318,318,
-													315,315,312,312,309,306,306,303,303,300,300,300,297,297,294,294,291,291,288,288,285,285,285,282,282,279,279,279,
-													276,276,273,273,273,270,270,267,267,267,264,264,264,261,261,261,258,258,258,255,255,255,252,252,252,249,249,249,
-													246,246,246,243,243,243,243,240,240,240,237,237,237,237,234,234,234,231,231,231,231,228,228,228,228,225,225,225,
-													225,222,222,222,222,219,219,219,219,216,216,216,216,213,213,213,213,210,210,210,210,210,207,207,207,207,204,204,
-													204,204,204,201,201,201,201,201,198,198,198,198,198,195,195,195,195,195,192,192,192,192,192,189,189,189,189,189,
-													186,186,186,186,186,183,183,183,183,183,183,180,180,180,180,180,177,177,177,177,177,177,174,174,174,174,174,174,
-													171,171,171,171,171,171,168,168,168,168,168,168,165,165,165,165,165,165,162,162,162,162,162,162,162,159,159,159,
-													159,159,159,156,156,156,156,156,156,156,153,153,153,153,153,153,153,150,150,150,150,150,150,150,147,147,147,147,
-													147,147,147,144,144,144,144,144,144,144,141,141,141,141,141,141,141,138,138,138,138,138,138,138,138,135,135,135,
-													135,135,135,135,135,132,132,132,132,132,132,132,129,129,129,129,129,129,129,129,126,126,126,126,126,126,126,126,
-													123,123,123,123,123,123,123,123,123,120,120,120,120,120,120,120,120,117,117,117,117,117,117,117,117,114,114,114,
-													114,114,114,114,114,114,111,111,111,111,111,111,111,111,111,108,108,108,108,108,108,108,108,105,105,105,105,105,
-													105,105,105,105,102,102,102,102,102,102,102,102,102,99,99,99,99,99,99,99,99,99,99,96,96,96,96,96,96,96,96,96,93,
-													93,93,93,93,93,93,93,93,90,90,90,90,90,90,90,90,90,90,87,87,87,87,87,87,87,87,87,84,84,84,84,84,84,84,84,84,84,81,
-													81,81,81,81,81,81,81,81,81,78,78,78,78,78,78,78,78,78,78,75,75,75,75,75,75,75,75,75,72,72,72,72,72,72,72,72,72,72,
-													69,69,69,69,69,69,69,69,69,69,66,66,66,66,66,66,66,66,66,66,63,63,63,63,63,63,63,63,63,63,63,60,60,60,60,60,60,60,
-													60,60,60,57,57,57,57,57,57,57,57,57,57,54,54,54,54,54,54,54,54,54,54,51,51,51,51,51,51,51,51,51,51,48,48,48,48,48,
-													48,48,48,48,48,45,45,45,45,45,45,45,45,45,45,45,42,42,42,42,42,42,42,42,42,42,39,39,39,39,39,39,39,39,39,39,36,36,
-													36,36,36,36,36,36,36,36,33,33,33,33,33,33,33,33,33,33,30,30,30,30,30,30,30,30,30,30,27,27,27,27,27,27,27,27,27,27,
-													24,24,24,24,24,24,24,24,24,24,21,21,21,21,21,21,21,21,21,21,18,18,18,18,18,18,18,18,18,15,15,15,15,15,15,15,15,15,
-													15,12,12,12,12,12,12,12,12,12,9,9,9,9,9,9,9,9,9,9,6,6,6,6,6,6,6,6,6,3,3,3,3,3,3,3,3,3,0,0,0,0,0,0,0,0,0,-3,-3,-3,-3,
-													-3,-3,-3,-3,-3,-6,-6,-6,-6,-6,-6,-6,-6,-6,-9,-9,-9,-9,-9,-9,-9,-9,-9,-12,-12,-12,-12,-12,-12,-12,-12,-15,-15,-15,-15,
-													-15,-15,-15,-15,-18,-18,-18,-18,-18,-18,-18,-18,-21,-21,-21,-21,-21,-21,-21,-21,-24,-24,-24,-24,-24,-24,-24,-24,-27,
-													-27,-27,-27,-27,-27,-27,-27,-30,-30,-30,-30,-30,-30,-30,-33,-33,-33,-33,-33,-33,-33,-36,-36,-36,-36,-36,-36,-36,-39,
-													-39,-39,-39,-39,-39,-39,-42,-42,-42,-42,-42,-42,-42,-45,-45,-45,-45,-45,-45,-45,-48,-48,-48,-48,-48,-48,-51,-51,-51,
-													-51,-51,-51,-54,-54,-54,-54,-54,-54,-57,-57,-57,-57,-57,-57,-60,-60,-60,-60,-60,-63,-63,-63,-63,-63,-63,-66,-66,-66,
-													-66,-66,-69,-69,-69,-69,-69,-72,-72,-72,-72,-72,-75,-75,-75,-75,-78,-78,-78,-78,-78,-81,-81,-81,-81,-84,-84,-84,-84,
-													-87,-87,-87,-87,-90,-90,-90,-90,-93,-93,-93,-93,-96,-96,-96,-99,-99,-99,-102,-102,-102,-102,-105,-105,-105,-108,-108,
-													-108,-111,-111,-114,-114,-114,-117,-117,-117,-120,-120,-123,-123,-126,-126,-129,-129,-132,-132,-135,-135,-138,-138,
-													-141,-141,-144,-147,-147,-150,-153,-153,-156,-159,-162,-165,-168,-171,-174,-177,-180,-186,-189,-195,-201,-207,-216,
-													-228,-240,-264};
-
 
 #endif /* CONFIGURATION_HPP_ */
@@ -0,0 +1,229 @@
+/*
+ * crc8.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the CRC8 implementation used by the bq76930 monitor
+ * (polynomial x8 + x2 + x + 1, initial value 0).
+ *
+ * The lookup tables are generated at compile time from the bitwise algorithm
+ * found in TI's example code, so they can't diverge from it.
+ * Two variants are available, selected at build time:
+ *
+ * default				256 bytes table, one lookup per byte
+ * CRC8_NIBBLE_TABLE	16 bytes table, two lookups per byte (saves flash)
+ *
+ * Define CRC8_BENCHMARK to build crc8::benchmark(), which measures the
+ * bitwise and the table driven implementations on target. The same comparison
+ * runs on the host with tools/crc8_benchmark.cpp, so this header has no target
+ * dependencies.
+ */
+
+#ifndef CRC8_HPP_
+#define CRC8_HPP_
+
+#include <stdint.h>
+
+namespace crc8
+{
+	/*
+	 * Bitwise CRC8 step, processes a single byte.
+	 * This is the original algorithm (www.ti.com/product/BQ76940/toolssoftware),
+	 * used as reference to generate the lookup tables.
+	 */
+	constexpr uint8_t bitwise_step(uint8_t crc, uint8_t data, uint8_t key)
+	{
+		for (uint8_t i=0x80; i!=0; i/=2)
+		{
+			if ((crc & 0x80) != 0)
+			{
+				crc = uint8_t(crc * 2);
+				crc ^= key;
+			}
+			else
+			{
+				crc = uint8_t(crc * 2);
+			}
+
+			if ((data & i) != 0)
+			{
+				crc ^= key;
+			}
+		}
+
+		return crc;
+	}
+
+	/*
+	 * Bitwise CRC8 of a whole buffer
+	 */
+	constexpr uint8_t bitwise(const uint8_t *input, uint8_t length, uint8_t key)
+	{
+		uint8_t crc = 0;
+
+		while (length-- != 0)
+		{
+			crc = bitwise_step(crc, *input++, key);
+		}
+
+		return crc;
+	}
+
+	/*
+	 * Full lookup table: entry i is the CRC of byte i (starting from 0)
+	 */
+	template<uint8_t KEY>
+	struct byte_table
+	{
+		uint8_t value[256];
+
+		constexpr byte_table() : value{}
+		{
+			for (int i=0; i<256; ++i)
+			{
+				value[i] = bitwise_step(0, uint8_t(i), KEY);
+			}
+		}
+	};
+
+	/*
+	 * Nibble lookup table: entry i is the CRC after shifting out the high nibble i
+	 */
+	template<uint8_t KEY>
+	struct nibble_table
+	{
+		uint8_t value[16];
+
+		constexpr nibble_table() : value{}
+		{
+			for (int i=0; i<16; ++i)
+			{
+				uint8_t crc = uint8_t(i << 4);
+
+				for (int bit=0; bit<4; ++bit)
+				{
+					crc = (crc & 0x80) ? uint8_t((crc * 2) ^ KEY) : uint8_t(crc * 2);
+				}
+				value[i] = crc;
+			}
+		}
+	};
+
+	template<uint8_t KEY>
+	struct tables
+	{
+		static constexpr byte_table<KEY> bytes = byte_table<KEY>();
+		static constexpr nibble_table<KEY> nibbles = nibble_table<KEY>();
+
+		static constexpr uint8_t byte_step(uint8_t crc, uint8_t data)
+		{
+			return bytes.value[crc ^ data];
+		}
+
+		static constexpr uint8_t nibble_step(uint8_t crc, uint8_t data)
+		{
+			crc = uint8_t(crc << 4) ^ nibbles.value[(crc >> 4) ^ (data >> 4)];
+			return uint8_t(crc << 4) ^ nibbles.value[(crc >> 4) ^ (data & 0x0F)];
+		}
+
+		/*
+		 * Both table steps against the reference one: every data byte from the initial 0,
+		 * and every running CRC (not only the initial 0) with 16 data bytes spread over the
+		 * whole range (all of them would exceed the compile time evaluation limits).
+		 */
+		static constexpr bool verify()
+		{
+			for (int crc=0; crc<256; ++crc)
+			{
+				for (int i=0; i<256; i+=(crc == 0 ? 1 : 17))
+				{
+					uint8_t reference = bitwise_step(uint8_t(crc), uint8_t(i), KEY);
+
+					if (byte_step(uint8_t(crc), uint8_t(i)) != reference || nibble_step(uint8_t(crc), uint8_t(i)) != reference)
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		/*
+		 * Both table variants against the reference algorithm on the frames exchanged with
+		 * the AFE at 7 bits \address: register writes (address, register, data) and reads
+		 * (address, data), for all the registers up to \last_register and all the data bytes
+		 */
+		static constexpr bool verify_frames(uint8_t address, uint8_t last_register)
+		{
+			for (int reg=0; reg<=last_register; ++reg)
+			{
+				for (int data=0; data<256; ++data)
+				{
+					const uint8_t write[3] = { uint8_t(address << 1), uint8_t(reg), uint8_t(data) };
+					const uint8_t read[2] = { uint8_t((address << 1) | 1), uint8_t(data) };
+
+					if (byte_crc(write, 3) != bitwise(write, 3, KEY) || nibble_crc(write, 3) != bitwise(write, 3, KEY) ||
+							byte_crc(read, 2) != bitwise(read, 2, KEY) || nibble_crc(read, 2) != bitwise(read, 2, KEY))
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		static constexpr uint8_t byte_crc(const uint8_t *input, uint8_t length)
+		{
+			uint8_t crc = 0;
+
+			while (length-- != 0) crc = byte_step(crc, *input++);
+			return crc;
+		}
+
+		static constexpr uint8_t nibble_crc(const uint8_t *input, uint8_t length)
+		{
+			uint8_t crc = 0;
+
+			while (length-- != 0) crc = nibble_step(crc, *input++);
+			return crc;
+		}
+	};
+
+	template<uint8_t KEY>
+	constexpr byte_table<KEY> tables<KEY>::bytes;
+	template<uint8_t KEY>
+	constexpr nibble_table<KEY> tables<KEY>::nibbles;
+
+	/*
+	 * Table driven CRC8 of a whole buffer (variant selected by CRC8_NIBBLE_TABLE)
+	 */
+	template<uint8_t KEY>
+	inline uint8_t compute(const uint8_t *input, uint8_t length)
+	{
+		uint8_t crc = 0;
+
+		while (length-- != 0)
+		{
+#ifdef CRC8_NIBBLE_TABLE
+			crc = tables<KEY>::nibble_step(crc, *input++);
+#else
+			crc = tables<KEY>::byte_step(crc, *input++);
+#endif
+		}
+
+		return crc;
+	}
+
+#ifdef CRC8_BENCHMARK
+	/*
+	 * Runs both implementations over the same buffer using SysTick as cycle counter,
+	 * checks that the results match and prints the cycles per byte over RTT.
+	 * SysTick is reconfigured, so call it before anything else relies on it.
+	 */
+	void benchmark();
+#endif
+}
+
+#endif /* CRC8_HPP_ */
@@ -0,0 +1,95 @@
+/*
+ * fixed_point.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the fixed point helpers used by the measurement conversions.
+ *
+ * The Cortex-M0 has no hardware divider: every integer division is a call to the
+ * runtime library (__aeabi_uidiv/__aeabi_idiv), tens of cycles each.
+ * Scaling by a constant ratio is done here as a 32 bits multiply and shift, with the
+ * multiplier derived at compile time from the ratio and the largest expected input.
+ *
+ * ratio<NUM, DEN, MAX>			x * NUM / DEN for |x| <= MAX
+ *
+ * Results are truncated like the division they replace. Each ratio exposes the largest
+ * error (in output LSB) against the exact division over its input range, so the users
+ * can check it with static_assert. The tighter MAX, the more precise the multiplier.
+ *
+ * Divisions by a power of 2 are left to the shift operator.
+ */
+
+#ifndef FIXED_POINT_HPP_
+#define FIXED_POINT_HPP_
+
+#include <stdint.h>
+
+namespace fixed
+{
+	/*
+	 * Multiplier of NUM / DEN with SHIFT fractional bits, rounded up: with this rounding
+	 * the product never falls below the exact value, so truncation can only match it or
+	 * exceed it by the error below.
+	 */
+	constexpr uint64_t multiplier(uint32_t num, uint32_t den, int shift)
+	{
+		return ((uint64_t(num) << shift) + den - 1) / den;
+	}
+
+	/*
+	 * Largest shift keeping max x multiplier within 32 bits
+	 */
+	constexpr int largest_shift(uint32_t num, uint32_t den, uint32_t max)
+	{
+		int shift = 0;
+
+		while (shift < 31 && uint64_t(max) * multiplier(num, den, shift + 1) <= 0xFFFFFFFFULL)
+		{
+			shift++;
+		}
+
+		return shift;
+	}
+
+	/*
+	 * Largest error (output LSB) of the multiply and shift over [0, max].
+	 * The multiplier exceeds NUM x 2^SHIFT / DEN by excess / DEN, so the product exceeds
+	 * x x NUM / DEN by at most max x excess / (DEN x 2^SHIFT). The fractional part of the
+	 * exact quotient is at most (DEN - 1) / DEN, so the truncated results differ by at most
+	 * the integer part of the sum of the two.
+	 */
+	constexpr uint32_t error_bound(uint32_t num, uint32_t den, uint32_t max, int shift)
+	{
+		return uint32_t((((uint64_t(den) - 1) << shift) + uint64_t(max) * (multiplier(num, den, shift) * den - (uint64_t(num) << shift)))
+				/ (uint64_t(den) << shift));
+	}
+
+	template<uint32_t NUM, uint32_t DEN, uint32_t MAX>
+	struct ratio
+	{
+		static_assert(DEN != 0, "Division by zero");
+
+		static constexpr int shift = largest_shift(NUM, DEN, MAX);
+		static constexpr uint32_t factor = uint32_t(multiplier(NUM, DEN, shift));
+
+		static_assert(uint64_t(MAX) * factor <= 0xFFFFFFFFULL, "Ratio too large for 32 bits");
+
+		/* 0: same result of x * NUM / DEN for every x in range */
+		static constexpr uint32_t max_error = error_bound(NUM, DEN, MAX, shift);
+
+		static constexpr uint32_t apply(uint32_t x)
+		{
+			return (x * factor) >> shift;
+		}
+
+		/* Truncated towards zero, like the signed division */
+		static constexpr int32_t apply(int32_t x)
+		{
+			return x < 0 ? -int32_t(apply(uint32_t(-x))) : int32_t(apply(uint32_t(x)));
+		}
+	};
+}
+
+#endif /* FIXED_POINT_HPP_ */
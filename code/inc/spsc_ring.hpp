@@ -0,0 +1,159 @@
+/*
+ * spsc_ring.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the single-producer/single-consumer ring buffer shared by the
+ * drivers (CAN reception and transmission, UART) and by the trace.
+ *
+ * One side (i.e. an interrupt handler) only pushes and the other one (i.e. the main loop)
+ * only pops, so no locking is needed:
+ * - head is written by the producer only, tail by the consumer only
+ * - both are free running counters: the number of items is head - tail, and the capacity
+ *   is a power of 2, so the slot of a counter is a mask (no division on the M0) and all
+ *   the SIZE slots can be used
+ * - the item is written (read) before publishing the new head (tail), with a compiler
+ *   barrier in between. The Cortex-M0 has a single core and doesn't reorder its memory
+ *   accesses, so the barrier is all the other side needs to see a complete item.
+ *
+ * Items are copied in and out: keep them small (see can::message for CAN frames).
+ */
+
+#ifndef SPSC_RING_HPP_
+#define SPSC_RING_HPP_
+
+#include <stdint.h>
+
+namespace ring
+{
+	/* Keeps the compiler from moving memory accesses across it */
+	inline void barrier()
+	{
+		__asm__ volatile ("" ::: "memory");
+	}
+
+	template<typename T, unsigned SIZE>
+	class spsc
+	{
+		static_assert(SIZE != 0 && (SIZE & (SIZE - 1)) == 0, "Ring size must be a power of 2");
+		static_assert(SIZE <= 32768, "Ring counters are 16 bits");
+
+	private:
+		static constexpr uint16_t MASK = SIZE - 1;
+
+		T items[SIZE];
+		volatile uint16_t head = 0;
+		volatile uint16_t tail = 0;
+
+	public:
+		static constexpr unsigned capacity = SIZE;
+
+		/*
+		 * Items waiting (either side) and free slots (producer)
+		 */
+		unsigned size() const
+		{
+			return uint16_t(head - tail);
+		}
+		unsigned space() const
+		{
+			return SIZE - size();
+		}
+		bool empty() const
+		{
+			return head == tail;
+		}
+		bool full() const
+		{
+			return size() == SIZE;
+		}
+
+		/*
+		 * Producer: appends an item, FALSE if the ring is full
+		 */
+		bool push(const T &item)
+		{
+			uint16_t position = head;
+
+			if (uint16_t(position - tail) == SIZE) return false;
+
+			items[position & MASK] = item;
+			barrier();
+			head = uint16_t(position + 1);
+
+			return true;
+		}
+
+		/*
+		 * Producer: appends all the n items or none of them
+		 */
+		bool write(const T *source, unsigned n)
+		{
+			uint16_t position = head;
+
+			if (n > SIZE - uint16_t(position - tail)) return false;
+
+			for (unsigned i=0; i<n; ++i)
+			{
+				items[(position + i) & MASK] = source[i];
+			}
+			barrier();
+			head = uint16_t(position + n);
+
+			return true;
+		}
+
+		/*
+		 * Consumer: removes the oldest item, FALSE if the ring is empty
+		 */
+		bool pop(T &item)
+		{
+			uint16_t position = tail;
+
+			if (position == head) return false;
+
+			item = items[position & MASK];
+			barrier();
+			tail = uint16_t(position + 1);
+
+			return true;
+		}
+
+		/*
+		 * Consumer: oldest items stored contiguously (up to the end of the storage), to be
+		 * used in place and then released
+		 */
+		unsigned contiguous(const T *&first) const
+		{
+			uint16_t position = tail;
+			unsigned count = uint16_t(head - position);
+			unsigned to_end = SIZE - (position & MASK);
+
+			barrier();
+			first = &items[position & MASK];
+
+			return count < to_end ? count : to_end;
+		}
+
+		/*
+		 * Consumer: drops the n oldest items (after contiguous())
+		 */
+		void release(unsigned n)
+		{
+			barrier();
+			tail = uint16_t(tail + n);
+		}
+
+		/*
+		 * Empties the ring, only while neither side is using it
+		 */
+		void clear()
+		{
+			tail = head;
+		}
+	};
+}
+
+#endif /* SPSC_RING_HPP_ */
@@ -0,0 +1,253 @@
+/*
+ * telemetry.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the bit-packed CAN telemetry of the BMS, shared by the firmware and
+ * by the host decoder (tools/telemetry_decoder.cpp), so it has no target dependencies.
+ *
+ * Every telemetry cycle sends the whole pack in a few 8 bytes frames, all of them carrying
+ * the same 4 bits sequence counter so the receiver can tell which frames belong together.
+ * Fields are packed LSB first (bit 0 is bit 0 of data[0]), signed fields in two's
+ * complement, and values out of range saturate.
+ *
+ * CELLS (BASE_ID + 0)			one frame every CELLS_PER_FRAME cells
+ *	 0.. 3	sequence
+ *	 4.. 7	group (first cell = group x CELLS_PER_FRAME)
+ *	 8..63	4 cells x 14 bits (mV), 0 = not present
+ *
+ * STATUS (BASE_ID + 1)
+ *	 0.. 3	sequence
+ *	 4..11	BMS state (state_t)
+ *	12..27	pack voltage (mV)
+ *	28..43	current (mA, signed, positive discharging)
+ *	44..53	state of charge (0.1%)
+ *	54..56	charge controller phase (charge::phase_t)
+ *	57		balancing
+ *	58..63	thermal runaway, one bit per sensor
+ *
+ * TEMPERATURES (BASE_ID + 2)	one frame every SENSORS_PER_FRAME sensors
+ *	 0.. 3	sequence
+ *	 4.. 7	group (first sensor = group x SENSORS_PER_FRAME)
+ *	 8..63	7 sensors x 8 bits (°C, signed), -128 = not present
+ *
+ * CHARGE (BASE_ID + 3)			charge controller (bms_charge.hpp), the charger follows the limit
+ *	 0.. 3	sequence
+ *	 4.. 6	charge controller phase (charge::phase_t)
+ *	 8..23	charge current limit at the measured temperatures (mA)
+ *	24..39	charge pauses because of the current limit
+ */
+
+#ifndef TELEMETRY_HPP_
+#define TELEMETRY_HPP_
+
+#include <stdint.h>
+
+namespace telemetry
+{
+	/* 11 bits CAN identifiers of the telemetry frames */
+	constexpr uint16_t BASE_ID				= 0x300;
+	constexpr uint16_t CELLS_ID				= BASE_ID + 0;
+	constexpr uint16_t STATUS_ID			= BASE_ID + 1;
+	constexpr uint16_t TEMPERATURES_ID		= BASE_ID + 2;
+	constexpr uint16_t CHARGE_ID			= BASE_ID + 3;
+
+	constexpr int FRAME_SIZE				= 8;
+	constexpr int CELLS_PER_FRAME			= 4;
+	constexpr int CELL_BITS					= 14;
+	constexpr int SENSORS_PER_FRAME			= 7;
+	constexpr int TEMPERATURE_BITS			= 8;
+	constexpr int RUNAWAY_BITS				= 6;
+
+	/* Groups are 4 bits */
+	constexpr int MAX_CELLS					= 16 * CELLS_PER_FRAME;
+	constexpr int MAX_SENSORS				= 16 * SENSORS_PER_FRAME;
+
+	constexpr int8_t NO_TEMPERATURE			= -128;
+
+	static_assert(8 + CELLS_PER_FRAME * CELL_BITS <= 8 * FRAME_SIZE, "Cells don't fit in a frame");
+	static_assert(8 + SENSORS_PER_FRAME * TEMPERATURE_BITS <= 8 * FRAME_SIZE, "Temperatures don't fit in a frame");
+
+	/*
+	 * Number of frames needed for \count cells or sensors
+	 */
+	constexpr int cell_frames(int count)
+	{
+		return (count + CELLS_PER_FRAME - 1) / CELLS_PER_FRAME;
+	}
+	constexpr int temperature_frames(int count)
+	{
+		return (count + SENSORS_PER_FRAME - 1) / SENSORS_PER_FRAME;
+	}
+
+	struct status
+	{
+		uint8_t state;
+		uint32_t pack_voltage;
+		int32_t current;
+		int16_t state_of_charge;
+		uint8_t charge_phase;
+		bool balancing;
+		uint8_t thermal_runaway;
+	};
+
+	/*
+	 * Writes the \width bits of \value at bit \position of the frame (frame zeroed before)
+	 */
+	inline void put(uint8_t *frame, int position, int width, uint32_t value)
+	{
+		for (int bit=0; bit<width; ++bit, ++position)
+		{
+			if (value & (1UL << bit)) frame[position >> 3] |= uint8_t(1 << (position & 7));
+		}
+	}
+
+	inline uint32_t get(const uint8_t *frame, int position, int width)
+	{
+		uint32_t value = 0;
+
+		for (int bit=0; bit<width; ++bit, ++position)
+		{
+			if (frame[position >> 3] & (1 << (position & 7))) value |= 1UL << bit;
+		}
+
+		return value;
+	}
+
+	inline int32_t get_signed(const uint8_t *frame, int position, int width)
+	{
+		uint32_t value = get(frame, position, width);
+
+		return int32_t(value ^ (1UL << (width - 1))) - int32_t(1UL << (width - 1));
+	}
+
+	/* Saturation to the field ranges */
+	inline uint32_t limit(uint32_t value, int width)
+	{
+		return value < (1UL << width) ? value : (1UL << width) - 1;
+	}
+	inline int32_t limit_signed(int32_t value, int width)
+	{
+		const int32_t max = int32_t(1UL << (width - 1)) - 1;
+
+		return value > max ? max : (value < -max - 1 ? -max - 1 : value);
+	}
+
+	inline void clear(uint8_t *frame)
+	{
+		for (int i=0; i<FRAME_SIZE; ++i) frame[i] = 0;
+	}
+
+	/*
+	 * CELLS frame \group, out of \n_cells voltages (mV)
+	 */
+	inline void encode_cells(uint8_t *frame, uint8_t sequence, int group, const uint16_t *voltages, int n_cells)
+	{
+		clear(frame);
+		put(frame, 0, 4, sequence);
+		put(frame, 4, 4, uint32_t(group));
+
+		for (int i=0; i<CELLS_PER_FRAME; ++i)
+		{
+			int cell = group * CELLS_PER_FRAME + i;
+
+			if (cell < n_cells) put(frame, 8 + i * CELL_BITS, CELL_BITS, limit(voltages[cell], CELL_BITS));
+		}
+	}
+
+	inline void encode_status(uint8_t *frame, uint8_t sequence, const status &data)
+	{
+		clear(frame);
+		put(frame, 0, 4, sequence);
+		put(frame, 4, 8, data.state);
+		put(frame, 12, 16, limit(data.pack_voltage, 16));
+		put(frame, 28, 16, uint32_t(limit_signed(data.current, 16)));
+		put(frame, 44, 10, limit(uint32_t(data.state_of_charge < 0 ? 0 : data.state_of_charge), 10));
+		put(frame, 54, 3, limit(data.charge_phase, 3));
+		put(frame, 57, 1, data.balancing);
+		put(frame, 58, RUNAWAY_BITS, data.thermal_runaway & ((1 << RUNAWAY_BITS) - 1));
+	}
+
+	/*
+	 * TEMPERATURES frame \group, out of \n_sensors temperatures (°C)
+	 */
+	inline void encode_temperatures(uint8_t *frame, uint8_t sequence, int group, const int16_t *temperatures, int n_sensors)
+	{
+		clear(frame);
+		put(frame, 0, 4, sequence);
+		put(frame, 4, 4, uint32_t(group));
+
+		for (int i=0; i<SENSORS_PER_FRAME; ++i)
+		{
+			int sensor = group * SENSORS_PER_FRAME + i;
+			/* -128 marks the missing sensors, so real readings stop at -127 */
+			int32_t value = sensor < n_sensors ? limit_signed(temperatures[sensor], TEMPERATURE_BITS) : NO_TEMPERATURE;
+
+			if (sensor < n_sensors && value == NO_TEMPERATURE) value++;
+			put(frame, 8 + i * TEMPERATURE_BITS, TEMPERATURE_BITS, uint32_t(value));
+		}
+	}
+
+	inline void encode_charge(uint8_t *frame, uint8_t sequence, uint8_t phase, uint16_t current_limit, uint16_t limit_pauses)
+	{
+		clear(frame);
+		put(frame, 0, 4, sequence);
+		put(frame, 4, 3, limit(phase, 3));
+		put(frame, 8, 16, current_limit);
+		put(frame, 24, 16, limit_pauses);
+	}
+
+	inline uint8_t sequence(const uint8_t *frame)
+	{
+		return uint8_t(get(frame, 0, 4));
+	}
+
+	inline int group(const uint8_t *frame)
+	{
+		return int(get(frame, 4, 4));
+	}
+
+	inline uint16_t cell(const uint8_t *frame, int i)
+	{
+		return uint16_t(get(frame, 8 + i * CELL_BITS, CELL_BITS));
+	}
+
+	inline int8_t temperature(const uint8_t *frame, int i)
+	{
+		return int8_t(get_signed(frame, 8 + i * TEMPERATURE_BITS, TEMPERATURE_BITS));
+	}
+
+	inline uint8_t charge_phase(const uint8_t *frame)
+	{
+		return uint8_t(get(frame, 4, 3));
+	}
+
+	inline uint16_t charge_limit(const uint8_t *frame)
+	{
+		return uint16_t(get(frame, 8, 16));
+	}
+
+	inline uint16_t charge_pauses(const uint8_t *frame)
+	{
+		return uint16_t(get(frame, 24, 16));
+	}
+
+	inline status decode_status(const uint8_t *frame)
+	{
+		status data;
+
+		data.state = uint8_t(get(frame, 4, 8));
+		data.pack_voltage = get(frame, 12, 16);
+		data.current = get_signed(frame, 28, 16);
+		data.state_of_charge = int16_t(get(frame, 44, 10));
+		data.charge_phase = uint8_t(get(frame, 54, 3));
+		data.balancing = get(frame, 57, 1) != 0;
+		data.thermal_runaway = uint8_t(get(frame, 58, RUNAWAY_BITS));
+
+		return data;
+	}
+}
+
+#endif /* TELEMETRY_HPP_ */
@@ -0,0 +1,138 @@
+/*
+ * thermistor.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the model of the NTC thermistors used for the LVB temperature
+ * measurements, replacing the 1024 entries lookup table generated by the MATLAB script.
+ *
+ * Every thermistor is the lower resistor of a divider whose upper resistor is equal to
+ * R25, so the 10 bits ADC reading is ADC = 1024 x R / (R + R25), and the temperature
+ * follows the Beta model:
+ *
+ * 1/T = 1/T25 + ln(R/R25) / BETA = 1/T25 + ln(ADC / (1024 - ADC)) / BETA
+ *
+ * The curve is evaluated at compile time every 2^SEGMENT_BITS ADC codes, so at runtime
+ * a temperature is just a linear interpolation between two table entries (shifts only).
+ * Temperatures are fixed point, in 1/2^FRACTION_BITS °C.
+ *
+ * The table is checked against the exact model at compile time (see verify), and the
+ * host tool tools/thermistor_report.cpp compares it with the old lookup table.
+ */
+
+#ifndef THERMISTOR_HPP_
+#define THERMISTOR_HPP_
+
+#include <stdint.h>
+
+namespace thermistor
+{
+	/* NTC Beta (B25/85, K) */
+	constexpr double BETA = 3435.0;
+	/* Reference temperature of R25 (K) */
+	constexpr double T25 = 298.15;
+	/* ADC full scale (10 bits) */
+	constexpr int ADC_RANGE = 1024;
+
+	/* Natural logarithm, for compile-time use only (no FP unit on the target) */
+	constexpr double ln(double x)
+	{
+		double result = 0;
+		double sum = 0;
+
+		/* Bring x into [0.5, 2], where the series below converges quickly */
+		while (x > 2) { x /= 2; result += 0.69314718055994530942; }
+		while (x < 0.5) { x *= 2; result -= 0.69314718055994530942; }
+
+		/* ln(x) = 2 x atanh((x - 1) / (x + 1)) */
+		double term = (x - 1) / (x + 1);
+		double square = term * term;
+		for (int n=1; n<80; n+=2)
+		{
+			sum += term / n;
+			term *= square;
+		}
+
+		return result + 2 * sum;
+	}
+
+	/*
+	 * Exact model: temperature (°C) of an ADC reading.
+	 * Both ends are clamped to the first and last codes (shorted/open thermistor).
+	 */
+	constexpr double model(int adc)
+	{
+		adc = adc < 1 ? 1 : (adc > ADC_RANGE - 1 ? ADC_RANGE - 1 : adc);
+
+		return 1 / (1 / T25 + ln(double(adc) / (ADC_RANGE - adc)) / BETA) - 273.15;
+	}
+
+	template<int SEGMENT_BITS, int FRACTION_BITS>
+	struct piecewise_linear
+	{
+		static constexpr int segments = ADC_RANGE >> SEGMENT_BITS;
+
+		/* Temperature at the start of every segment, plus the end of the last one */
+		int16_t value[segments + 1];
+
+		constexpr piecewise_linear() : value{}
+		{
+			for (int i=0; i<=segments; ++i)
+			{
+				double t = model(i << SEGMENT_BITS) * (1 << FRACTION_BITS);
+
+				value[i] = int16_t(t < 0 ? t - 0.5 : t + 0.5);
+			}
+		}
+
+		/* Temperature of an ADC reading (1/2^FRACTION_BITS °C) */
+		constexpr int16_t temperature(uint16_t adc) const
+		{
+			return int16_t(value[adc >> SEGMENT_BITS] +
+					(((value[(adc >> SEGMENT_BITS) + 1] - value[adc >> SEGMENT_BITS]) * (adc & ((1 << SEGMENT_BITS) - 1))) >> SEGMENT_BITS));
+		}
+
+		/*
+		 * TRUE if every ADC code whose temperature is in [min, max] °C is interpolated within
+		 * \tolerance (1/2^FRACTION_BITS °C) of the exact model
+		 */
+		constexpr bool verify(int min, int max, int tolerance) const
+		{
+			for (int adc=0; adc<ADC_RANGE; ++adc)
+			{
+				double exact = model(adc);
+				double error = temperature(uint16_t(adc)) - exact * (1 << FRACTION_BITS);
+
+				if (exact >= min && exact <= max && (error > tolerance || error < -tolerance)) return false;
+			}
+			return true;
+		}
+	};
+
+	/* Segments of 16 ADC codes (65 entries), temperatures in 1/16 °C */
+	constexpr int SEGMENT_BITS = 4;
+	constexpr int FRACTION_BITS = 4;
+
+	typedef piecewise_linear<SEGMENT_BITS, FRACTION_BITS> curve_type;
+
+	template<typename CURVE>
+	struct tables
+	{
+		static constexpr CURVE curve = CURVE();
+	};
+
+	template<typename CURVE>
+	constexpr CURVE tables<CURVE>::curve;
+
+	/*
+	 * Temperature of an ADC reading (1/16 °C)
+	 */
+	inline int16_t temperature(uint16_t adc)
+	{
+		return tables<curve_type>::curve.temperature(adc);
+	}
+}
+
+#endif /* THERMISTOR_HPP_ */
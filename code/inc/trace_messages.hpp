@@ -0,0 +1,51 @@
+/*
+ * trace_messages.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * This header contains the messages of the binary trace (see bms_trace.hpp), shared by the
+ * firmware and by the host decoder (tools/), so it has no target dependencies.
+ *
+ * Every message is X(NAME, format, arguments): the firmware only gets the NAME as trace ID
+ * (the position in the list), the format is used by the host to print the message again.
+ * Formats take integer conversions only (%d, %u, %x, %X with flags and width).
+ *
+ * New messages go at the end of the list, and changing the meaning of an existing one
+ * requires a new TRACE_VERSION, so old captures can still be decoded.
+ *
+ * Stream layout, one record after the other:
+ * ID (1 byte)			position of the message in the list
+ * delta time			ms since the previous record (unsigned LEB128)
+ * arguments			as many as the message takes (signed, zigzag LEB128)
+ */
+
+#ifndef TRACE_MESSAGES_HPP_
+#define TRACE_MESSAGES_HPP_
+
+#define TRACE_VERSION		1
+
+#define TRACE_MESSAGES(X) \
+	X(TRACE_START,			"TRACE START\tversion %d\n",		1) \
+	X(TRACE_DROPPED,		"TRACE DROPPED\t%d\n",				1) \
+	X(CELL_VOLTAGE,			"CELL VOLTAGE\t(%d): %d\n",			2) \
+	X(CURRENT,				"CURRENT\t%d\n",					1) \
+	X(BATTERY_VOLTAGE,		"BATTERY VOLTAGE\t%d\n",			1) \
+	X(TEMPERATURE,			"TEMPERATURES\t(%d) %d\n",			2) \
+	X(THERMAL_RUNAWAY,		"THERMAL RUNAWAY\t0x%02X\n",		1) \
+	X(BMS_STATE,			"BMS_STATE\t0x%02X\n",				1) \
+	X(BALANCING_CHARGE,		"Enable balancing when charging\n",	0) \
+	X(CHARGE_INITIATED,		"Charging Initiated\n",				0) \
+	X(CHARGE_FINISHED,		"Charging Finished\n",				0) \
+	X(CHARGE_ABORTED,		"Charging Aborted\t0x%02X\n",		1) \
+	X(CHARGE_PHASE,			"CHARGE PHASE\t%d\n",				1)
+
+/*
+ * Text-only spellings printed by the older firmwares, X(NAME, format): the host decodes them
+ * as message NAME (same arguments). The binary trace never uses them.
+ */
+#define TRACE_TEXT_ALIASES(X) \
+	X(CURRENT,				"Current\t%d\n")
+
+#endif /* TRACE_MESSAGES_HPP_ */
@@ -7,9 +7,37 @@
 
 #include "BQ76930.hpp"
 
-void BQ76930::init()
+namespace
 {
-	i2c::init(I2C_INTERFACE, I2C_SPEED);
+	/* Alert flag of the monitor served by the ALERT pin interrupt (see init_alert) */
+	volatile bool *alert_target = 0;
+
+	/* Channel the I2C mux is routed to, -1 if unknown */
+	volatile int8_t mux_selected = -1;
+
+	/* A failed selection leaves the mux in an unknown state */
+	void mux_done(i2c::transaction *t)
+	{
+		if (t->status != I2C_STATUS_DONE) mux_selected = -1;
+	}
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::init(uint8_t i2c_address, int8_t i2c_mux_channel)
+{
+	address = i2c_address;
+	mux_channel = i2c_mux_channel;
+	mux_pending = false;
+	mux_selected = -1;
+
+	/* Nothing is known about the AFE registers yet */
+	shadow_valid = 0;
+
+	/* Coulomb counter always in continuous mode (CC_READY every 250ms) */
+	cc_mode = CC_EN;
+
+	//Factory ADC gain and offset (needed by the OV/UV thresholds)
+	read_calibration();
 
 	//CC_CFG default value
 	write_register(cc_cfg, CC_CFG);
@@ -18,10 +46,10 @@ void BQ76930::init()
 	write_register(sys_ctrl1, ADC_EN);
 
 	//OV threshold
-	write_register(ov_trip, OV_THRESH);
+	write_register(ov_trip, trip_threshold(OV_THRESH));
 
 	//UV threshold
-	write_register(uv_trip, UV_THRESH);
+	write_register(uv_trip, trip_threshold(UV_THRESH));
 
 	//OCD threshold and delay
 	write_register(protect1, SCD_VAL);
@@ -36,48 +64,200 @@ void BQ76930::init()
 	write_register(sys_ctrl2, FET_DISABLE);
 
 	//Disables balancing operations at startup, prevents errors
-	write_register(cellbal1, BAL_OFF);
-	write_register(cellbal2, BAL_OFF);
+	for (int group=0; group<pack_layout::balancing_registers; ++group)
+	{
+		write_register(TI_Register_ID(cellbal1 + group), BAL_OFF);
+	}
 }
 
-void BQ76930::write_register(const TI_Register_ID reg, uint8_t data)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::write_register(const TI_Register_ID reg, uint8_t data, bool force)
 {
 	uint8_t crc_val = 0;
+	bool shadowed = is_shadowed(reg);
+
+	/* Keep the coulomb counter mode along with the FET bits */
+	if (reg == sys_ctrl2) data |= cc_mode;
+
+	/* Skip the transaction if the AFE already holds the same value */
+	if (shadowed && !force && (shadow_valid & (1 << reg)) && shadow_registers[reg] == cached_bits(reg, data)) return;
 
 	/* Calculate CRC on the specific register and data to be sent */
-	crc_wr[0] = I2C_ADDRESS << 1;
+	crc_wr[0] = uint8_t(address << 1);
 	crc_wr[1] = reg;
 	crc_wr[2] = data;
-	crc_val = CRC8(crc_wr, 3, CRC_KEY);
+	crc_val = CRC8(crc_wr, 3);
 
 	write_data[0] = reg;
 	write_data[1] = data;
 	write_data[2] = crc_val;
 
-	if (i2c::send(I2C_INTERFACE, I2C_ADDRESS, 3, write_data) == 0) error_bit = true;
+	select();
+	if (i2c::send(I2C_INTERFACE, address, 3, write_data) == 0)
+	{
+		error_bit = true;
+		if (shadowed) invalidate_register(reg);
+	}
+	else if (shadowed)
+	{
+		shadow_registers[reg] = cached_bits(reg, data);
+		shadow_valid |= 1 << reg;
+	}
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::check_registers(void)
+{
+	uint32_t valid;
+	uint8_t value;
+
+	valid = read_block(cellbal1, CONFIG_REGISTERS, config_buffer);
+
+	for (uint8_t i=0; i<CONFIG_REGISTERS; ++i)
+	{
+		TI_Register_ID reg = TI_Register_ID(cellbal1 + i);
+		value = cached_bits(reg, config_buffer[2 * i]);
+
+		/* Only compare registers with a valid readback and a known shadow value */
+		if (!is_shadowed(reg) || !(valid & (1UL << i)) || !(shadow_valid & (1 << reg))) continue;
+
+		if (value == shadow_registers[reg]) continue;
+
+		register_mismatches++;
+
+		if (reg == sys_ctrl2)
+		{
+			/* FETs may have been opened by the AFE itself, don't close them again from here */
+			shadow_registers[reg] = value;
+		}
+		else
+		{
+			write_register(reg, shadow_registers[reg], true);
+		}
+	}
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::read_calibration(void)
+{
+	uint8_t gain1[2];
+	uint8_t offset[2];
+	uint8_t gain2[2];
+
+	/* ADC_GAIN1 and ADC_OFFSET are subsequent registers, ADC_GAIN2 is separated */
+	if ((read_block(adc_gain1, 1, gain1) & read_block(adc_offset, 1, offset) & read_block(adc_gain2, 1, gain2)) != 1)
+	{
+		return;
+	}
+
+	adc_gain_uv = 365 + (((gain1[0] & 0x0C) << 1) | ((gain2[0] & 0xE0) >> 5));
+	adc_offset_mv = int8_t(offset[0]);
+
+	/* Rounded Q16 mV/LSB */
+	gain_factor = ((uint32_t(adc_gain_uv) << 16) + 500) / 1000;
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::init_alert(void)
+{
+	alert_target = &alert_flag;
+	alert_flag = false;
+
+	/* ALERT is driven high by the AFE whenever a SYS_STAT bit is set */
+	gpio::enable_interrupt(pin::ALERT, true);
+	NVIC_ClearPendingIRQ(EINT0_IRQn);
+	NVIC_EnableIRQ(EINT0_IRQn);
 }
 
-uint8_t BQ76930::read_register(TI_Register_ID reg)
+template<bq769x0::variant V, uint16_t TAPS>
+bool BQ769x0<V, TAPS>::alert_pending(void)
 {
-	if (i2c::command_read(I2C_INTERFACE, I2C_ADDRESS, reg, 2, read_data) == 0) error_bit = true;
+	bool pending = alert_flag || gpio::get_state(pin::ALERT);
+
+	alert_flag = false;
+
+	return pending;
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+uint8_t BQ769x0<V, TAPS>::read_register(TI_Register_ID reg)
+{
+	select();
+	if (i2c::command_read(I2C_INTERFACE, address, reg, 2, read_data) == 0) error_bit = true;
 
 	return read_data[0];
 }
 
-uint16_t BQ76930::read_voltage(const TI_Register_ID reg_lo, const TI_Register_ID reg_hi)
+template<bq769x0::variant V, uint16_t TAPS>
+uint32_t BQ769x0<V, TAPS>::read_block(const TI_Register_ID reg, uint8_t length, uint8_t *data)
+{
+	select();
+	if (i2c::command_read(I2C_INTERFACE, address, reg, 2 * length, data) != 2 * length)
+	{
+		error_bit = true;
+		return 0;
+	}
+
+	return check_block(length, data);
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::select(void)
+{
+	if (mux_channel < 0 || mux_channel == mux_selected) return;
+
+	/* The previous selection may still be queued */
+	if (mux_pending) i2c::wait(&mux_transaction);
+
+	mux_command = uint8_t(1 << mux_channel);
+	mux_transaction.address = bms_config::i2c_mux_address;
+	mux_transaction.send_data = &mux_command;
+	mux_transaction.send_size = 1;
+	mux_transaction.receive_data = 0;
+	mux_transaction.receive_size = 0;
+	mux_transaction.callback = mux_done;
+
+	mux_selected = mux_channel;
+	mux_pending = i2c::submit(&mux_transaction);
+	if (!mux_pending) mux_selected = -1;
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+uint32_t BQ769x0<V, TAPS>::check_block(uint8_t length, const uint8_t *data)
+{
+	uint32_t valid = 0;
+
+	/* First byte: CRC over slave address (read) and data */
+	crc_rd[0] = uint8_t((address << 1) | 1);
+	crc_rd[1] = data[0];
+	if (CRC8(crc_rd, 2) == data[1]) valid |= 1;
+
+	/* Following bytes: CRC over the data byte only */
+	for (uint8_t i=1; i<length; ++i)
+	{
+		crc_rd[0] = data[2 * i];
+		if (CRC8(crc_rd, 1) == data[2 * i + 1]) valid |= 1UL << i;
+	}
+
+	return valid;
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+uint16_t BQ769x0<V, TAPS>::read_voltage(const TI_Register_ID reg_lo, const TI_Register_ID reg_hi)
 {
 	uint16_t adc_data = 0;
 	uint16_t voltage = 0;
 
 	/* Retrieve cell voltage ADC readout */
-	if ((i2c::command_read(I2C_INTERFACE, I2C_ADDRESS, reg_hi, 2, voltage_buffer_high) == 0) ||
-			(i2c::command_read(I2C_INTERFACE, I2C_ADDRESS, reg_lo, 2, voltage_buffer_low) == 0)) error_bit = true;
+	select();
+	if ((i2c::command_read(I2C_INTERFACE, address, reg_hi, 2, voltage_buffer_high) == 0) ||
+			(i2c::command_read(I2C_INTERFACE, address, reg_lo, 2, voltage_buffer_low) == 0)) error_bit = true;
 
 	//Preparing voltage data from register (ADC readings)
 	adc_data = ((voltage_buffer_high[0] & 0x3F) << 8) | (voltage_buffer_low[0] & 0xFF);
 
 	//Adapt voltage data to ADC GAIN and ADC OFFSET
-	voltage = (uint16_t)(((adc_data * ADC_GAIN) / 1000) + ADC_OFFSET);
+	voltage = adc_to_voltage(adc_data);
 
 	return voltage;
 }
@@ -86,75 +266,61 @@ uint16_t BQ76930::read_voltage(const TI_Register_ID reg_lo, const TI_Register_ID
  * This function basically uses the BQ76930::read_voltage function, where reg_hi = bat_hi and
  * reg_lo = bat_lo registers on the monitor.
  * The only difference is how the value is displayed: in the function above, result is obtained after updating
- * the 14bits ADC reading with the respective ADC_GAIN and ADC_OFFSET.
+ * the 14bits ADC reading with the respective adc_gain_uv and adc_offset_mv.
  * In the function below, the data is already displayed as a 16bits value and it needs to be converted using
  * the equation displayed in the header file.
  */
-void BQ76930::read_battery_voltage(void)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::read_battery_voltage(void)
 {
 	uint16_t adc_data = 0;
 
-	/* Retrieve battery voltage ADC readout */
-	if ((i2c::command_read(I2C_INTERFACE, I2C_ADDRESS, bat_hi, 2, voltage_buffer_high) == 0) ||
-			(i2c::command_read(I2C_INTERFACE, I2C_ADDRESS, bat_lo, 2, voltage_buffer_low) == 0)) error_bit = true;
+	/* Retrieve battery voltage ADC readout (BAT_HI and BAT_LO in a single block) */
+	if (read_block(bat_hi, 2, battery_buffer) != 3)
+	{
+		if (!error_bit) crc_errors++;
+		return;
+	}
 
 	//Preparing voltage data from register (16bits)
-	adc_data = ((voltage_buffer_high[0] & 0xFF) << 8) | (voltage_buffer_low[0] & 0xFF);
+	adc_data = ((battery_buffer[0] & 0xFF) << 8) | (battery_buffer[2] & 0xFF);
 
-	//Adapt battery voltage
-	battery_voltage = (uint16_t)(((adc_data * ADC_GAIN * 4) / 1000) + (ADC_OFFSET * bms_config::n_cells));
+	//Adapt battery voltage (4 x adc_gain_uv, thus a 14 bits shift)
+	battery_voltage = uint16_t(((adc_data * gain_factor) >> 14) + (adc_offset_mv * n_cells));
 }
 
-void BQ76930::enable_balancing(int cell)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::enable_balancing(uint16_t cells)
 {
-	uint8_t crc_val = 0;
-	uint8_t balancing_register = cell < 4 ? cellbal1 : cellbal2;
-	int balancing_cell;
+	uint8_t balancing_registers[pack_layout::balancing_registers] = { BAL_OFF };
 
-	/* Calculate the correct balancing cell value that's going to be
-	 * written in the cellbal register */
-	switch(cell)
+	for (int cell=0; cell<n_cells; ++cell)
 	{
-	case 6:
-	case 3:
-		balancing_cell = 4;
-		break;
-
-	case 5:
-		balancing_cell = 1;
-		break;
-
-	case 4:
-		balancing_cell = 0;
-		break;
-
-	case 2:
-	case 1:
-	case 0:
-	default:
-		balancing_cell = cell;
-		break;
+		if (cells & (1 << cell))
+		{
+			balancing_registers[pack_layout::cells.group[cell]] |= uint8_t(1 << pack_layout::cells.bit[cell]);
+		}
 	}
 
-	/* Calculate CRC on the specific register and data to be sent */
-	crc_wr[0] = I2C_ADDRESS << 1;
-	crc_wr[1] = balancing_register;
-	crc_wr[2] |= 1 << balancing_cell;
-	crc_val = CRC8(crc_wr, 3, CRC_KEY);
-
-	write_data[0] = balancing_register;
-	write_data[1] |= 1 << cell;
-	write_data[2] = crc_val;
+	/* Unchanged registers are skipped by write_register (shadow copy) */
+	for (int group=0; group<pack_layout::balancing_registers; ++group)
+	{
+		write_register(TI_Register_ID(cellbal1 + group), balancing_registers[group]);
+	}
 
-	if (i2c::send(I2C_INTERFACE, I2C_ADDRESS, 3, write_data) == 0) error_bit = true;
+	balancing_mask = cells;
 }
 
-void BQ76930::disable_balancing(void)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::disable_balancing(void)
 {
-	/* By writing a 0 in every bit in these two registers, it disables balacing
+	/* By writing a 0 in every bit in the CELLBAL registers, it disables balacing
 	 * for all cells in the BMS */
-	write_register(cellbal1, BAL_OFF);
-	write_register(cellbal2, BAL_OFF);
+	for (int group=0; group<pack_layout::balancing_registers; ++group)
+	{
+		write_register(TI_Register_ID(cellbal1 + group), BAL_OFF);
+	}
+	balancing_mask = 0;
 
 	/* Signals that balancing procedure has finished */
 	gpio::clear(pin::UT_ERROR);
@@ -163,35 +329,47 @@ void BQ76930::disable_balancing(void)
 	balancing_enabled = false;
 }
 
-void BQ76930::check_balancing(bool activate)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::check_balancing(bool activate)
 {
 	if (activate)	/*Checks and enables balancing */
 	{
-		int num_balancing_cells = 0;
+		uint16_t deviation[n_cells];
+		uint16_t candidates = 0;
+		uint16_t best_plan = 0;
+		uint32_t best_deviation = 0;
 
-		for (int cell=0; cell<bms_config::n_cells; ++cell)
+		for (int cell=0; cell<n_cells; ++cell)
 		{
 			/* Balancing enabling condition */
-			if (voltage_readings[cell] > min_voltage)
+			deviation[cell] = voltage_readings[cell] > min_voltage ? uint16_t(voltage_readings[cell] - min_voltage) : 0;
+			if (deviation[cell] > 0)
 			{
-				/* Checks for adjacency condition, and that the current cell is not already balancing */
-				if ((num_balancing_cells < bms_config::max_balancing_cells) && check_adjacency(cell) && !is_balancing(cell))
-				{
-					balancing_cells[num_balancing_cells] = cell;
-					num_balancing_cells++;
-				}
+				candidates |= uint16_t(1 << cell);
 			}
 		}
 
-		for (int i=0; i<bms_config::max_balancing_cells; ++i)
+		/* Highest total deviation among the plans made only of candidate cells */
+		for (int plan=0; plan<pack_layout::n_plans; ++plan)
 		{
-			/* Checks that all balancing cells are in correct range
-			 * and that no random cells are balanced */
-			if (balancing_cells[i] < 7)
+			uint16_t cells = pack_layout::plans.cells[plan];
+			uint32_t total = 0;
+
+			if (cells & ~candidates) continue;
+
+			for (int cell=0; cell<n_cells; ++cell)
+			{
+				if (cells & (1 << cell)) total += deviation[cell];
+			}
+
+			if (total > best_deviation)
 			{
-				enable_balancing(balancing_cells[i]);
+				best_deviation = total;
+				best_plan = cells;
 			}
 		}
+
+		enable_balancing(best_plan);
 	}
 	else /* Checks and disables balancing */
 	{
@@ -205,19 +383,61 @@ void BQ76930::check_balancing(bool activate)
 	}
 }
 
-void BQ76930::read_cellvoltages(void)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::start_cellvoltages(void)
 {
+	if (cell_pending) return;
+
+	cell_command = vc1_hi;
+	cell_transaction.address = address;
+	cell_transaction.send_data = &cell_command;
+	cell_transaction.send_size = 1;
+	cell_transaction.receive_data = block_buffer;
+	cell_transaction.receive_size = sizeof(block_buffer);
+	cell_transaction.callback = 0;
+
+	select();
+	cell_pending = i2c::submit(&cell_transaction);
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::read_cellvoltages(void)
+{
+	uint32_t valid = 0;
+	uint32_t cell_mask;
+	uint8_t *cell_data;
+
+	/* Queue the block read now if it hasn't been started before */
+	start_cellvoltages();
+
+	if (!cell_pending || i2c::wait(&cell_transaction) != I2C_STATUS_DONE || cell_transaction.received != sizeof(block_buffer))
+	{
+		error_bit = true;
+	}
+	else
+	{
+		valid = check_block(pack_layout::cell_registers, block_buffer);
+	}
+	cell_pending = false;
+
 	/*
-	 * As said before, this function only calls the function read_voltage
-	 * for all the cells connected to the AFE
+	 * Decode every connected cell straight from the block buffer.
+	 * Both VCx_HI and VCx_LO have to pass the CRC check, otherwise the reading is discarded.
 	 */
-	voltage_readings[0] = read_voltage(vc1_lo, vc1_hi);
-	voltage_readings[1] = read_voltage(vc2_lo, vc2_hi);
-	voltage_readings[2] = read_voltage(vc3_lo, vc3_hi);
-	voltage_readings[3] = read_voltage(vc5_lo, vc5_hi);
-	voltage_readings[4] = read_voltage(vc6_lo, vc6_hi);
-	voltage_readings[5] = read_voltage(vc7_lo, vc7_hi);
-	voltage_readings[6] = read_voltage(vc10_lo, vc10_hi);
+	for (int cell=0; cell<n_cells; ++cell)
+	{
+		cell_mask = 3UL << (2 * pack_layout::cells.tap[cell]);
+		cell_data = &block_buffer[4 * pack_layout::cells.tap[cell]];
+
+		if ((valid & cell_mask) == cell_mask)
+		{
+			voltage_readings[cell] = adc_to_voltage(((cell_data[0] & 0x3F) << 8) | (cell_data[2] & 0xFF));
+		}
+		else if (!error_bit)
+		{
+			crc_errors++;
+		}
+	}
 
 	/* Calculate minimum, maximum and average voltage for the cells pack */
 	min();
@@ -225,13 +445,53 @@ void BQ76930::read_cellvoltages(void)
 	avg();
 }
 
-void BQ76930::read_stateofcharge(void)
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::init_stateofcharge(uint16_t capacity, int16_t initial_soc)
+{
+	/* mAh to nAs, then to CC counts: the only divisions of the SoC path, done once here */
+	pack_capacity = int64_t(capacity) * 3600 * 1000000 / CC_CHARGE;
+	if (pack_capacity < 1) pack_capacity = 1;
+	initial_charge = pack_capacity * initial_soc / 1000;
+	/* Rounded up, so a full pack reads exactly 100.0% */
+	soc_factor = ((int64_t(1000) << SOC_SHIFT) + pack_capacity - 1) / pack_capacity;
+	cc_accumulator = 0;
+	state_of_charge = initial_soc;
+}
+
+template<bq769x0::variant V, uint16_t TAPS>
+void BQ769x0<V, TAPS>::read_stateofcharge(void)
 {
 	int16_t twos_complement = 0;
+	int64_t charge = 0;
+
+	/* Retrieve register value, both bytes have to pass the CRC check */
+	if (read_block(cc_hi, 2, cc_buffer) != 3)
+	{
+		if (!error_bit) crc_errors++;
+		return;
+	}
+	twos_complement = int16_t(((cc_buffer[0] & 0xFF) << 8) | (cc_buffer[2] & 0xFF));
+
+	/* Average current over the CC period (µV / mΩ = mA) */
+	cc_current = int16_t(cc_ratio::apply(int32_t(twos_complement)));
 
-	/* Retrieve register value */
-	twos_complement = ((read_register(cc_hi) & 0xFF) << 8) | (read_register(cc_lo) & 0xFF);
+	/* Integrate and calculate state of charge */
+	cc_accumulator += twos_complement;
+	charge = initial_charge + cc_accumulator;
 
-	/* Calculate state of charge */
-	state_of_charge = int16_t((twos_complement * CC_LSB) / 1000);
+	if (charge < 0) charge = 0;
+	if (charge > pack_capacity) charge = pack_capacity;
+
+	state_of_charge = int16_t((charge * soc_factor) >> SOC_SHIFT);
+}
+
+/* Driver of the AFE configured in configuration.hpp */
+template class BQ769x0<bms_config::afe_variant, bms_config::cell_taps>;
+
+void afe_alert_interrupt(void)
+{
+	if (alert_target)
+	{
+		*alert_target = true;
+	}
 }
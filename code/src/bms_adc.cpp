@@ -5,6 +5,7 @@
  *      Author: @fedefiorini
  */
 #include "bms_adc.hpp"
+#include "spsc_ring.hpp"
 
 #include "SEGGER_RTT.h"
 
@@ -14,7 +15,296 @@ namespace adc
 
 	int16_t temperature_readings[bms_config::n_temperature_sensors] 	= {0};
 	int16_t current_sense 												= 0;
-	int temperature_counters[bms_config::n_temperature_sensors] 		= {0};
+	int16_t current_peak 												= 0;
+	int16_t current_rms 												= 0;
+	uint16_t current_overruns 											= 0;
+	int16_t current_offset 												= 0;
+	bool current_calibrated 											= false;
+	int16_t temperature_rates[bms_config::n_temperature_sensors] 		= {0};
+	uint8_t thermal_runaway 											= 0;
+	int overtemperature_counters[bms_config::n_temperature_sensors] 	= {0};
+	int undertemperature_counters[bms_config::n_temperature_sensors] 	= {0};
+
+	namespace
+	{
+		/* Channels converted in every scan, the interrupt comes from the last one */
+		const uint32_t scan_channels = (1 << ADC_CH2) | (1 << ADC_CH3) | (1 << ADC_CH6) | (1 << ADC_CH7);
+		const ADC_CHANNEL_T scan_last = ADC_CH7;
+
+		/* Double buffered scan results, scan_buffers[front] is the last completed scan */
+		volatile uint16_t scan_buffers[2][ADC_CHANNELS] = {{0}};
+		volatile uint8_t front = 0;
+		volatile bool scan_running = false;
+		/* Completed scans, time base of the temperature rate of rise */
+		volatile uint32_t scans = 0;
+
+		/*
+		 * Zero current output of the Current_Amp OPAMP (see schematics): 1.8V, in half ADC LSB
+		 * (2 x 1.8V / 3223µV = 1116.97, rounded to the nearest)
+		 */
+		const int32_t current_zero = (2 * 1800000 + LSB / 2) / LSB;
+
+		/*
+		 * Sums over a window of Current_Amp samples, centered on current_zero (half LSB).
+		 * Every centered sample is within +/-current_zero, so the sums fit in 32 bits.
+		 */
+		struct current_window
+		{
+			int32_t sum;
+			uint32_t sum_squares;
+			int16_t min;
+			int16_t max;
+		};
+
+		static_assert((bms_config::current_window & (bms_config::current_window - 1)) == 0, "Current window must be a power of 2");
+		static_assert(uint64_t(bms_config::current_window) * bms_config::current_window * current_zero * current_zero < (1ULL << 32),
+				"Current window too long for 32 bits sums");
+
+		/*
+		 * Centered samples (half LSB) to mA: V - 1.8V = sample x LSB / 2 (µV), then divided by
+		 * the OPAMP gain (20) and sense_resistor (mΩ). The window mean folds in the division by
+		 * the window length.
+		 */
+		typedef fixed::ratio<LSB, 2 * 20 * bms_config::sense_resistor, current_zero> sample_to_current;
+		typedef fixed::ratio<LSB, 2 * 20 * bms_config::sense_resistor * bms_config::current_window,
+				bms_config::current_window * current_zero> window_to_current;
+		typedef fixed::ratio<LSB, 2 * 20 * bms_config::sense_resistor * bms_config::current_window * bms_config::current_calibration_windows,
+				bms_config::current_window * bms_config::current_calibration_windows * current_zero> calibration_to_current;
+		static_assert(sample_to_current::max_error <= 1 && window_to_current::max_error <= 1, "Current conversion too coarse");
+		static_assert(calibration_to_current::max_error <= 2, "Current offset calibration too coarse");
+
+		/*
+		 * Zero offset drift filter (mA, OFFSET_FRACTION_BITS fixed point) and windows spent at rest.
+		 * The fractional bits keep the filter moving for differences well below 1mA.
+		 */
+		const int OFFSET_FRACTION_BITS = 12;
+		int32_t offset_filter = 0;
+		int rest_windows = 0;
+
+		/* Window being filled by the ADC interrupt */
+		current_window accumulator = { 0, 0, INT16_MAX, INT16_MIN };
+		int accumulated = 0;
+
+		/*
+		 * Completed windows: written by the ADC interrupt, read by measure_current(). Same
+		 * protocol as ring::spsc, a slot is written (read) before publishing the new head
+		 * (tail), with a compiler barrier in between.
+		 */
+		current_window windows[CURRENT_WINDOWS];
+		volatile uint8_t windows_head = 0;
+		volatile uint8_t windows_tail = 0;
+
+		static_assert(bms_config::temperature_multiplier == 1 << thermistor::FRACTION_BITS, "Temperature scale doesn't match the thermistor model");
+		static_assert(thermistor::tables<thermistor::curve_type>::curve.verify(-40, 125, bms_config::temperature_multiplier * 5 / 8),
+				"Thermistor model interpolation error above 0.625°C");
+
+		/* Temperature pipeline of a sensor, temperatures in 1/16 °C */
+		struct temperature_filter
+		{
+			int16_t history[bms_config::temperature_median];	//Last readings (ring)
+			uint8_t next;										//Oldest reading
+			bool primed;										//History filled with the first reading
+			int32_t filtered;									//IIR output (temperature_filter_shift extra fractional bits)
+			int16_t rate_reference;								//Filtered temperature at the last rate update
+			uint8_t rate_exceeded;								//Rate periods in a row above the limit
+		};
+
+		static_assert(bms_config::temperature_median % 2 == 1 && bms_config::temperature_median <= 7, "Median filter must be odd and short");
+		static_assert(60000 % bms_config::temperature_rate_period == 0, "Rate period must divide one minute");
+
+		temperature_filter filters[bms_config::n_temperature_sensors];
+		uint32_t rate_scan = 0;
+
+		/* Scans in a rate period, and rate period to minutes */
+		const uint32_t rate_period_scans = bms_config::current_sample_rate * bms_config::temperature_rate_period / 1000;
+		const int32_t rate_periods_per_minute = 60000 / bms_config::temperature_rate_period;
+
+		/*
+		 * Median of the history of a sensor (insertion sort of a copy, a handful of elements)
+		 */
+		int16_t median(const temperature_filter &filter)
+		{
+			int16_t sorted[bms_config::temperature_median];
+
+			for (int i=0; i<bms_config::temperature_median; ++i)
+			{
+				int16_t value = filter.history[i];
+				int j = i;
+
+				for (; j>0 && sorted[j - 1] > value; --j)
+				{
+					sorted[j] = sorted[j - 1];
+				}
+				sorted[j] = value;
+			}
+
+			return sorted[bms_config::temperature_median / 2];
+		}
+
+		/*
+		 * Feeds a reading (1/16 °C) to the pipeline of a sensor, returns the filtered temperature
+		 */
+		int16_t filter_temperature(int sensor, int16_t temperature)
+		{
+			temperature_filter &filter = filters[sensor];
+
+			/* The first reading fills the pipeline, so it doesn't start from 0°C */
+			if (!filter.primed)
+			{
+				for (int i=0; i<bms_config::temperature_median; ++i)
+				{
+					filter.history[i] = temperature;
+				}
+				filter.filtered = int32_t(temperature) << bms_config::temperature_filter_shift;
+				filter.rate_reference = temperature;
+				filter.primed = true;
+			}
+
+			filter.history[filter.next] = temperature;
+			if (++filter.next == bms_config::temperature_median) filter.next = 0;
+
+			filter.filtered += ((int32_t(median(filter)) << bms_config::temperature_filter_shift) - filter.filtered) >> bms_config::temperature_filter_shift;
+
+			return int16_t((filter.filtered + (1 << (bms_config::temperature_filter_shift - 1))) >> bms_config::temperature_filter_shift);
+		}
+
+		/*
+		 * Rate of rise of a sensor over the last rate period, and thermal runaway warning
+		 */
+		void update_rate(int sensor, int16_t temperature)
+		{
+			temperature_filter &filter = filters[sensor];
+
+			/* Large steps (shorted or open sensor) saturate instead of wrapping to a negative rate */
+			int32_t rate = (int32_t(temperature) - filter.rate_reference) * rate_periods_per_minute;
+
+			temperature_rates[sensor] = int16_t(rate > INT16_MAX ? INT16_MAX : (rate < INT16_MIN ? INT16_MIN : rate));
+			filter.rate_reference = temperature;
+
+			if (temperature_rates[sensor] > bms_config::temperature_rate_max * bms_config::temperature_multiplier)
+			{
+				if (filter.rate_exceeded < bms_config::temperature_rate_count) filter.rate_exceeded++;
+			}
+			else
+			{
+				filter.rate_exceeded = 0;
+			}
+
+			if (filter.rate_exceeded >= bms_config::temperature_rate_count)
+			{
+				thermal_runaway |= uint8_t(1 << sensor);
+			}
+			else
+			{
+				thermal_runaway &= uint8_t(~(1 << sensor));
+			}
+		}
+
+		/* Integer square root */
+		uint32_t square_root(uint32_t value)
+		{
+			uint32_t root = 0;
+			uint32_t bit = 1UL << 30;
+
+			while (bit > value) bit >>= 2;
+
+			while (bit != 0)
+			{
+				if (value >= root + bit)
+				{
+					value -= root + bit;
+					root = (root >> 1) + bit;
+				}
+				else
+				{
+					root >>= 1;
+				}
+				bit >>= 2;
+			}
+
+			return root;
+		}
+
+		/*
+		 * Per-state correction added to the calibrated offset
+		 */
+		int16_t state_correction()
+		{
+			if (bms_state == CHARGE || bms_state == CHARGE_AND_BAL)
+			{
+				return bms_config::charge_current_offset;
+			}
+			return 0;
+		}
+
+		/*
+		 * Zero offset drift tracking, fed with the uncorrected mean current (mA) of every window.
+		 * Only READY and BALANCING are rest states (balancing current doesn't flow through the
+		 * sense resistor); the filter is updated once the current has been within
+		 * bms_config::current_rest_band of zero long enough.
+		 */
+		void track_offset(int32_t current)
+		{
+			if ((bms_state != READY && bms_state != BALANCING) || abs(current - current_offset) > bms_config::current_rest_band)
+			{
+				rest_windows = 0;
+				return;
+			}
+
+			if (rest_windows < bms_config::current_rest_windows)
+			{
+				rest_windows++;
+				return;
+			}
+
+			offset_filter += ((current << OFFSET_FRACTION_BITS) - offset_filter) >> bms_config::current_drift_shift;
+
+			if (offset_filter > (int32_t(bms_config::current_offset_limit) << OFFSET_FRACTION_BITS))
+			{
+				offset_filter = int32_t(bms_config::current_offset_limit) << OFFSET_FRACTION_BITS;
+			}
+			if (offset_filter < -(int32_t(bms_config::current_offset_limit) << OFFSET_FRACTION_BITS))
+			{
+				offset_filter = -(int32_t(bms_config::current_offset_limit) << OFFSET_FRACTION_BITS);
+			}
+
+			current_offset = int16_t((offset_filter + (1 << (OFFSET_FRACTION_BITS - 1))) >> OFFSET_FRACTION_BITS);
+		}
+
+		/*
+		 * Decimator input (ADC interrupt): every bms_config::current_window samples
+		 * the window is queued for measure_current()
+		 */
+		void accumulate(uint16_t raw)
+		{
+			int16_t sample = int16_t(2 * raw - current_zero);
+
+			accumulator.sum += sample;
+			accumulator.sum_squares += uint32_t(sample * sample);
+			if (sample < accumulator.min) accumulator.min = sample;
+			if (sample > accumulator.max) accumulator.max = sample;
+
+			if (++accumulated < bms_config::current_window) return;
+
+			uint8_t next = (windows_head + 1) & (CURRENT_WINDOWS - 1);
+			if (next != windows_tail)
+			{
+				windows[windows_head] = accumulator;
+				ring::barrier();
+				windows_head = next;
+			}
+			else
+			{
+				current_overruns++;
+			}
+
+			accumulator.sum = 0;
+			accumulator.sum_squares = 0;
+			accumulator.min = INT16_MAX;
+			accumulator.max = INT16_MIN;
+			accumulated = 0;
+		}
+	}
 
 	void init_adc()
 	{
@@ -39,66 +329,197 @@ namespace adc
 
 		/* Enable temperature readings */
 		gpio::set(pin::temp_EN);
+
+		/* Burst scan: all the channels selected at once, one interrupt at the end of the scan */
+		LPC_ADC->CR |= scan_channels;
+		Chip_ADC_Int_SetGlobalCmd(LPC_ADC, DISABLE);
+		Chip_ADC_Int_SetChannelCmd(LPC_ADC, scan_last, ENABLE);
+		scan_running = false;
+
+		/*
+		 * Measurements rely on a completed scan, so the first one is polled (this also runs
+		 * from WAKEUP_IRQHandler, where the ADC interrupt couldn't preempt).
+		 * Loop intentionally left void.
+		 */
+		NVIC_DisableIRQ(ADC_IRQn);
+		start_scan();
+		while (Chip_ADC_ReadStatus(LPC_ADC, scan_last, ADC_DR_DONE_STAT) != SET) {}
+		scan_handler();
+		NVIC_ClearPendingIRQ(ADC_IRQn);
+		NVIC_EnableIRQ(ADC_IRQn);
+
+		init_sampling();
+	}
+
+	void init_sampling()
+	{
+		Chip_TIMER_Init(LPC_TIMER32_1);
+		Chip_TIMER_Reset(LPC_TIMER32_1);
+
+		/* Match 0 restarts the timer and starts a scan every sampling period */
+		Chip_TIMER_SetMatch(LPC_TIMER32_1, 0, Chip_Clock_GetSystemClockRate() / bms_config::current_sample_rate - 1);
+		Chip_TIMER_ResetOnMatchEnable(LPC_TIMER32_1, 0);
+		Chip_TIMER_MatchEnableInt(LPC_TIMER32_1, 0);
+
+		NVIC_ClearPendingIRQ(TIMER_32_1_IRQn);
+		NVIC_EnableIRQ(TIMER_32_1_IRQn);
+
+		Chip_TIMER_Enable(LPC_TIMER32_1);
+	}
+
+	void stop_sampling()
+	{
+		Chip_TIMER_Disable(LPC_TIMER32_1);
+		NVIC_DisableIRQ(TIMER_32_1_IRQn);
+		NVIC_ClearPendingIRQ(TIMER_32_1_IRQn);
+	}
+
+	void start_scan()
+	{
+		if (scan_running) return;
+
+		scan_running = true;
+		Chip_ADC_SetBurstCmd(LPC_ADC, ENABLE);
 	}
 
-	uint16_t read(ADC_CHANNEL_T adc_channel)
+	const volatile uint16_t *samples()
 	{
-		uint16_t data;
+		return scan_buffers[front];
+	}
 
-		Chip_ADC_EnableChannel(LPC_ADC, adc_channel, ENABLE);
+	void scan_handler()
+	{
+		uint8_t back = front ^ 1;
 
-		//A/D conversion
-		Chip_ADC_SetStartMode(LPC_ADC, ADC_START_NOW, ADC_TRIGGERMODE_RISING);
+		/* One scan only: a conversion of the next sweep already started (if any) is ignored */
+		Chip_ADC_SetBurstCmd(LPC_ADC, DISABLE);
 
-		//Wait for A/D conversion to be finished (loop intentionally left void)
-		while (Chip_ADC_ReadStatus(LPC_ADC, adc_channel, ADC_DR_DONE_STAT) != SET) {}
+		for (int channel=0; channel<ADC_CHANNELS; ++channel)
+		{
+			if (scan_channels & (1 << channel))
+			{
+				/* Reading the data register also clears its DONE flag */
+				scan_buffers[back][channel] = uint16_t(ADC_DR_RESULT(LPC_ADC->DR[channel]));
+			}
+		}
 
-		//Read value
-		Chip_ADC_ReadValue(LPC_ADC, adc_channel, &data);
-		Chip_ADC_EnableChannel(LPC_ADC, adc_channel, DISABLE);
+		front = back;
+		scan_running = false;
+		scans++;
 
-		return data;
+		accumulate(scan_buffers[back][ADC_CH6]);
 	}
 
 	void measure_current()
 	{
-		uint16_t sense_voltage;
+		int16_t min = INT16_MAX;
+		int16_t max = INT16_MIN;
+		current_window latest;
+		bool completed = false;
+		int32_t mean;
+		int32_t rms;
+		int32_t offset;
+		int32_t current_max;
+		int32_t current_min;
+		int64_t mean_square;
 
-		/* Read out Current_Amp digital value */
-		sense_voltage = read(ADC_CH6);
+		/* Collect the windows completed since the last call */
+		while (windows_tail != windows_head)
+		{
+			/* Copied after seeing the new head and before releasing the slot to the interrupt */
+			ring::barrier();
+			latest = windows[windows_tail];
+			ring::barrier();
+			completed = true;
 
-		/* Obtain readable current value in mA
-		 * The values of sense_resistor and LSB anre in µΩ and µV/LSB, respectively,
-		 * so it's required to convert the result in mA before reading that out */
-		/* Need to subtract 1.8V from the voltage readout as it's a threshold in the
-		 * OPAMP that gives out such voltage (--see schematics) */
-		current_sense = int16_t(((((sense_voltage * LSB) - 1800000) / 20) / bms_config::sense_resistor));
-		if (bms_state == CHARGE || bms_state == CHARGE_AND_BAL)
+			if (latest.min < min) min = latest.min;
+			if (latest.max > max) max = latest.max;
+
+			windows_tail = (windows_tail + 1) & (CURRENT_WINDOWS - 1);
+		}
+
+		if (!completed) return;
+
+		/*
+		 * Mean and RMS of the latest window (its length is a power of 2, so there's no
+		 * division by the number of samples), peak over all of them.
+		 * Need to subtract 1.8V from the voltage readout as it's a threshold in the
+		 * OPAMP that gives out such voltage (--see schematics), done by accumulate().
+		 * What's left is the calibrated zero offset, plus the per-state correction.
+		 */
+		mean = window_to_current::apply(latest.sum);
+		track_offset(mean);
+		offset = current_offset + state_correction();
+
+		current_sense = int16_t(mean - offset);
+
+		current_max = sample_to_current::apply(int32_t(max)) - offset;
+		current_min = sample_to_current::apply(int32_t(min)) - offset;
+		current_peak = int16_t(abs(current_max) >= abs(current_min) ? current_max : current_min);
+
+		/*
+		 * sqrt(sum_squares / N) = sqrt(sum_squares x N) / N, then the offset is removed from
+		 * the mean square: E[(I - offset)^2] = E[I^2] - 2 x offset x E[I] + offset^2
+		 */
+		rms = window_to_current::apply(square_root(latest.sum_squares * bms_config::current_window));
+		mean_square = int64_t(rms) * rms - 2 * int64_t(offset) * mean + int64_t(offset) * offset;
+		if (mean_square < 0) mean_square = 0;
+		if (mean_square > INT16_MAX * INT16_MAX) mean_square = INT16_MAX * INT16_MAX;
+		current_rms = int16_t(square_root(uint32_t(mean_square)));
+	}
+
+	void calibrate_current()
+	{
+		int32_t sum = 0;
+		int32_t offset;
+
+		/* Windows completed before the call may have seen current flowing */
+		windows_tail = windows_head;
+
+		/* Loop intentionally left void, a window completes every 16ms */
+		for (int i=0; i<bms_config::current_calibration_windows; ++i)
 		{
-			current_sense -= bms_config::charge_current_offset;
+			while (windows_tail == windows_head) {}
+
+			ring::barrier();
+			sum += windows[windows_tail].sum;
+			ring::barrier();
+			windows_tail = (windows_tail + 1) & (CURRENT_WINDOWS - 1);
 		}
+
+		offset = calibration_to_current::apply(sum);
+		current_calibrated = abs(offset) <= bms_config::current_offset_limit;
+		if (!current_calibrated) offset = 0;
+
+		current_offset = int16_t(offset);
+		offset_filter = offset << OFFSET_FRACTION_BITS;
+		rest_windows = 0;
 	}
 
 	void measure_temperature()
 	{
 		int16_t temperature = 0;
 		uint16_t adc_out = 0;
+		const volatile uint16_t *scan = samples();
+		bool rate_update = scans - rate_scan >= rate_period_scans;
+
+		if (rate_update) rate_scan = scans;
 
-		/* Read out values from TempX pin */
+		/* Read out values of the TempX pins from the last scan */
 		for (int i=0; i<bms_config::n_temperature_sensors; i++)
 		{
 			switch(i)
 			{
 			case 0:
-				adc_out = read(ADC_CH2);
+				adc_out = scan[ADC_CH2];
 				break;
 
 			case 1:
-				adc_out = read(ADC_CH3);
+				adc_out = scan[ADC_CH3];
 				break;
 
 			case 2:
-				adc_out = read(ADC_CH7);
+				adc_out = scan[ADC_CH7];
 				break;
 
 			default:
@@ -106,74 +527,84 @@ namespace adc
 				break;
 			}
 
-			/* Retrieve the temperature value from the lookup table */
-			temperature = thermistor_lookup_table[adc_out];
+			/* Interpolate the temperature (1/16 °C) from the thermistor model */
+			temperature = filter_temperature(i, thermistor::temperature(adc_out));
+
+			if (rate_update) update_rate(i, temperature);
 
 			check(i, temperature);
-			temperature_readings[i] = int16_t(temperature / 3);
+			temperature_readings[i] = int16_t(temperature >> thermistor::FRACTION_BITS);
 		}
 	}
 
 	void check(int sensor, int16_t temperature)
 	{
-		/* When charging, the maximum and high temperature threshold change (lowers),
-		 * thus this variable gets written with the correct thresholds at any given state
+		/* When charging, the maximum temperature threshold changes (lowers),
+		 * thus this variable gets written with the correct threshold at any given state
 		 * whenever performing measurements */
-		int16_t temperature_threshold_high;
 		int16_t temperature_threshold_max;
 		if (bms_state == CHARGE || bms_state == CHARGE_AND_BAL)
 		{
 			temperature_threshold_max 	= bms_config::charging_temperature_max;
-			temperature_threshold_high 	= bms_config::charging_temperature_high;
 		}
 		else
 		{
 			temperature_threshold_max 	= bms_config::temperature_max;
-			temperature_threshold_high 	= bms_config::temperature_high;
 		}
 
-		if (temperature > temperature_threshold_high * bms_config::temperature_multiplier)
+		if (temperature > temperature_threshold_max * bms_config::temperature_multiplier - 1)
 		{
-			if (temperature > temperature_threshold_max * bms_config::temperature_multiplier - 1)
+			if (overtemperature_counters[sensor] < bms_config::max_wrong_temp)
 			{
-				if (temperature_counters[sensor] < bms_config::max_wrong_temp)
-				{
-					temperature_counters[sensor]++;
-				}
-				else
-				{
-					/* Open DSG FET and raise an error */
-					monitor.write_register(sys_ctrl2, monitor.FET_DISABLE);
-					state::set_state(OVERTEMPERATURE);
-					gpio::set(pin::OT_ERROR);
-				}
+				overtemperature_counters[sensor]++;
 			}
 			else
 			{
-				/* High Temperature */
+				/* Open DSG FET and raise an error (entry action of the state) */
+				state::set_state(OVERTEMPERATURE);
 			}
 		}
-		else if (temperature < bms_config::temperature_low * bms_config::temperature_multiplier)
+		else if (overtemperature_counters[sensor] > 0)
+		{
+			overtemperature_counters[sensor]--;
+		}
+
+		if (temperature < bms_config::temperature_min * bms_config::temperature_multiplier + 1)
 		{
-			if (temperature < bms_config::temperature_min * bms_config::temperature_multiplier + 1)
+			if (undertemperature_counters[sensor] < bms_config::max_wrong_temp)
 			{
-				if (temperature_counters[sensor] < bms_config::max_wrong_temp)
-				{
-					temperature_counters[sensor]++;
-				}
-				else
-				{
-					/* Open DSG FET and raise an error */
-					monitor.write_register(sys_ctrl2, monitor.FET_DISABLE);
-					state::set_state(UNDERTEMPERATURE);
-					gpio::set(pin::UT_ERROR);
-				}
+				undertemperature_counters[sensor]++;
 			}
 			else
 			{
-				/* Low Temperature */
+				/* Open DSG FET and raise an error (entry action of the state) */
+				state::set_state(UNDERTEMPERATURE);
 			}
 		}
+		else if (undertemperature_counters[sensor] > 0)
+		{
+			undertemperature_counters[sensor]--;
+		}
 	}
 }
 
+/*
+ * ADC Interrupt Handler (needs extern "C" declaration to properly work)
+ * Raised once per scan, by the last channel of the scan.
+ */
+extern "C" __attribute__ ((interrupt)) void ADC_IRQHandler(void)
+{
+	adc::scan_handler();
+}
+
+/*
+ * Sampling timer interrupt handler (needs extern "C" declaration to properly work)
+ */
+extern "C" __attribute__ ((interrupt)) void TIMER32_1_IRQHandler(void)
+{
+	if (Chip_TIMER_MatchPending(LPC_TIMER32_1, 0))
+	{
+		Chip_TIMER_ClearMatch(LPC_TIMER32_1, 0);
+		adc::start_scan();
+	}
+}
@@ -6,6 +6,8 @@
  */
 
 #include "bms_can.hpp"
+#include "bms_events.hpp"
+#include "spsc_ring.hpp"
 
 #include "protocol.hpp"
 #include "ecu.hpp"
@@ -24,111 +26,127 @@ __BSS(RESERVED) char CAN_driver_memory[256];
 
 namespace
 {
+	/* Received frames, ISR pushes and the main loop pops */
+	ring::spsc<can::message, CAN_RX_QUEUE_SIZE> rx_queue;
+
 	/*
-	 * This class represents a buffer of CAN frames.
-	 * Parameter SIZE represents the amout of frames that can fit into the buffer
+	 * Callback function called by the ISR() upon message reception
 	 */
-	template<unsigned int SIZE>
-	class Buffer
+	void CAN_rx(uint8_t msg_obj_num)
 	{
-		/*
-		 * Read_Pointer is the index of the next entry to be read in the Buffer
-		 * Write_Pointer is the index of the next entry to write to in the Buffer
-		 */
-		uint8_t read_pointer = 0;
-		uint8_t write_pointer = 0;
-
-		CCAN_MSG_OBJ buffer[SIZE];
-
-	public:
-		/*
-		 * Returns whether the buffer is full
-		 */
-		inline bool is_full()
-		{
-			return (write_pointer + 1) % SIZE == read_pointer;
-		}
+		CCAN_MSG_OBJ msg_obj;
+		can::message frame;
 
-		/*
-		 * Returns whether the buffer is empty
-		 */
-		inline bool is_empty()
-		{
-			return write_pointer == read_pointer;
-		}
+		/* The message object is always read, to free it */
+		msg_obj.msgobj = msg_obj_num;
+		LPC_CCAN_API->can_receive(&msg_obj);
 
-		/*
-		 * Get the next element to be filled in the buffer.
-		 * When data is retrieved, use push() to get the message into the buffer
-		 */
-		inline CCAN_MSG_OBJ *get_front()
-		{
-			return &buffer[write_pointer];
-		}
+		if (msg_obj_num != 1) return;
 
-		/*
-		 * Get the last element of the buffer.
-		 * When data is read, use pop() to delete this message
-		 */
-		inline const CCAN_MSG_OBJ *get_back()
-		{
-			return &buffer[read_pointer];
-		}
+		frame.id = uint16_t(msg_obj.mode_id);
+		frame.length = msg_obj.dlc <= 8 ? msg_obj.dlc : 8;
+		for (uint8_t i = 0; i < frame.length; i++) frame.data[i] = msg_obj.data[i];
 
-		/*
-		 * Push next element into the buffer
-		 */
-		inline void push()
-		{
-			write_pointer = (write_pointer + 1) % SIZE;
-		}
+		/* Dropped if the queue is full */
+		if (rx_queue.push(frame)) events::post(events::CAN_RX);
+	}
 
-		/*
-		 * Remove last element from the buffer
-		 */
-		inline void pop()
-		{
-			read_pointer = (read_pointer + 1) % SIZE;
-		}
-	};
+	/*
+	 * Transmission queues, one for each priority (main loop pushes, popped when loading the
+	 * message objects with the interrupts masked, or from the interrupt)
+	 */
+	typedef ring::spsc<can::message, CAN_TX_QUEUE_SIZE> tx_queue;
+
+	static_assert(CAN_TX_FIRST_OBJECT + CAN_TX_OBJECTS <= 33, "C_CAN has 32 message objects");
+
+	tx_queue tx_queues[can::N_PRIORITIES];
 
-	Buffer<50> buffer;
+	/* Message objects waiting for their frame to be transmitted, bit 0 = CAN_TX_FIRST_OBJECT */
+	volatile uint32_t tx_busy = 0;
 
 	/*
-	 * Callback function called by the ISR() upon message reception
+	 * C_CAN transmits the pending message objects in number order, whatever the order they
+	 * were loaded in: the fault frames get the lowest numbered object, the telemetry the
+	 * following ones
 	 */
-	void CAN_rx(uint8_t msg_obj_num)
+	constexpr uint8_t fault_object = CAN_TX_FIRST_OBJECT;
+	constexpr uint8_t telemetry_object = CAN_TX_FIRST_OBJECT + 1;
+	constexpr uint32_t telemetry_busy = ((1UL << CAN_TX_OBJECTS) - 1) & ~1UL;
+
+	static_assert(can::N_PRIORITIES == 2, "Message objects split between faults and telemetry");
+	static_assert(CAN_TX_OBJECTS >= 2, "CAN transmission needs a fault and a telemetry object");
+
+	void transmit(uint8_t object, const can::message &frame)
 	{
-		/* Receive only if the new message fits into the buffer */
-		if (!buffer.is_full() && msg_obj_num == 1)
+		CCAN_MSG_OBJ msg_obj;
+
+		msg_obj.msgobj = object;
+		msg_obj.mode_id = frame.id;
+		msg_obj.mask = 0x0;
+		msg_obj.dlc = frame.length;
+		for (uint8_t i = 0; i < frame.length; i++) msg_obj.data[i] = frame.data[i];
+
+		tx_busy |= 1UL << (object - CAN_TX_FIRST_OBJECT);
+
+		LPC_CCAN_API->can_transmit(&msg_obj);
+	}
+
+	/*
+	 * Loads the queued frames in the free message objects.
+	 * Interrupts masked, or from the CAN interrupt.
+	 *
+	 * Telemetry frames are loaded in batches, only once all the telemetry objects are
+	 * free, earliest frame in the lowest numbered object: a later frame never overtakes
+	 * an earlier one with the same identifier.
+	 */
+	void load(void)
+	{
+		can::message frame;
+
+		if (!(tx_busy & 1UL) && tx_queues[can::PRIORITY_FAULT].pop(frame))
 		{
-			buffer.get_front()->msgobj = msg_obj_num;
-			LPC_CCAN_API->can_receive(buffer.get_front());
-			buffer.push();
+			transmit(fault_object, frame);
 		}
-		else
-		{
-			CCAN_MSG_OBJ tmp;
 
-			tmp.msgobj = msg_obj_num;
-			LPC_CCAN_API->can_receive(&tmp);
+		if (tx_busy & telemetry_busy) return;
+
+		for (uint8_t object=telemetry_object; object<CAN_TX_FIRST_OBJECT + CAN_TX_OBJECTS; ++object)
+		{
+			if (!tx_queues[can::PRIORITY_TELEMETRY].pop(frame)) break;
+			transmit(object, frame);
 		}
 	}
 
 	/*
-	 * This parameter is used to communicate between the transmit callback function
-	 * and the transmit method.
-	 * If a new message is transmitted without waiting for the previous one to be actually
-	 * sent, the message wouldn't be transmitted.
+	 * Callback function called by the ISR() upon message transmission:
+	 * the message objects are refilled from the queues
 	 */
-	volatile bool transmitting = false;
+	void CAN_tx(uint8_t msg_obj_num)
+	{
+		if (msg_obj_num < CAN_TX_FIRST_OBJECT || msg_obj_num >= CAN_TX_FIRST_OBJECT + CAN_TX_OBJECTS) return;
+
+		tx_busy &= ~(1UL << (msg_obj_num - CAN_TX_FIRST_OBJECT));
+		load();
+	}
 
 	/*
-	 * Callback function called by the ISR() upon message transmission
+	 * Clears the message valid and the transmission request of a message object, through
+	 * the IF1 registers (the ROM driver only uses them from the interrupt or with the
+	 * interrupts masked, as this file does):
+	 * - IF1_CMDMSK: WR (bit 7), ARB (bit 5) and CTRL (bit 4) transferred to the object
+	 * - IF1_ARB2: MSGVAL (bit 15) cleared
+	 * - IF1_MCTRL: TXRQST (bit 8) and INTPND (bit 13) cleared
+	 * - IF1_CMDREQ: object number starts the transfer, BUSY (bit 15) while running
 	 */
-	void CAN_tx(__attribute__ ((unused)) uint8_t msg_obj_num)
+	void invalidate(uint8_t object)
 	{
-		transmitting = false;
+		LPC_CAN->IF1_CMDMSK = (1UL << 7) | (1UL << 5) | (1UL << 4);
+		LPC_CAN->IF1_ARB1 = 0;
+		LPC_CAN->IF1_ARB2 = 0;
+		LPC_CAN->IF1_MCTRL = 0;
+		LPC_CAN->IF1_CMDREQ = object;
+
+		while (LPC_CAN->IF1_CMDREQ & (1UL << 15)) {}
 	}
 
 	/*
@@ -138,9 +156,17 @@ namespace
 	{
 		if (error_num & CAN_ERROR_BOFF)
 		{
-			/* Resets the CAN bus */
+			/*
+			 * Resets the CAN bus, the frames in the message objects are lost: the objects are
+			 * invalidated first (INIT is still set), so none of them is transmitted after the
+			 * reset while tx_busy marks it free and load() writes a new frame over it
+			 */
+			for (uint8_t object=CAN_TX_FIRST_OBJECT; object<CAN_TX_FIRST_OBJECT + CAN_TX_OBJECTS; ++object)
+			{
+				invalidate(object);
+			}
+			tx_busy = 0;
 			LPC_CAN->CNTL &= ~1;
-			transmitting = false;
 		}
 	}
 }
@@ -157,6 +183,9 @@ extern "C" __attribute__ ((interrupt)) void CAN_IRQHandler(void)
 
 namespace can
 {
+	uint16_t tx_dropped[N_PRIORITIES] = {0};
+	uint8_t tx_high_water[N_PRIORITIES] = {0};
+
 	void init_can()
 	{
 		/* Initialize the CAN peripheral */
@@ -173,6 +202,10 @@ namespace can
 
 		LPC_CCAN_API->init_can(&can_init_settings[0], 1);
 
+		for (int level=0; level<N_PRIORITIES; ++level) tx_queues[level].clear();
+		rx_queue.clear();
+		tx_busy = 0;
+
 		/* Configure the callbacks */
 		CCAN_CALLBACKS callbacks =
 		{
@@ -204,38 +237,31 @@ namespace can
 		gpio::set(pin::CAN_EN);
 	}
 
-	void send(message *msg)
+	bool send(const message *msg, priority level)
 	{
-		volatile uint32_t count = 0;
+		tx_queue &queue = tx_queues[level];
+		uint32_t primask;
 
-		/* Busy waits upon completion of previous message transmission */
-		while (transmitting && count++ < 0x0A00);
+		if (!queue.push(*msg))
+		{
+			if (tx_dropped[level] < UINT16_MAX) tx_dropped[level]++;
+			return false;
+		}
 
-		CCAN_MSG_OBJ msg_obj;
-		msg_obj.msgobj = 2;
-		msg_obj.mode_id = msg->id;
-		msg_obj.mask = 0x0;
-		msg_obj.dlc = msg->length;
-		for (uint8_t i = 0; i < msg->length; i++) msg_obj.data[i] = msg->data[i];
+		if (queue.size() > tx_high_water[level]) tx_high_water[level] = uint8_t(queue.size());
 
-		transmitting = true;
+		/* Starts the free message objects (the busy ones restart from the interrupt) */
+		primask = __get_PRIMASK();
+		__disable_irq();
+		load();
+		__set_PRIMASK(primask);
 
-		LPC_CCAN_API->can_transmit(&msg_obj);
+		return true;
 	}
 
 	bool receive(message *msg)
 	{
-		if (buffer.is_empty()) return false;	/* No message received */
-		else
-		{
-			msg->id = buffer.get_back()->mode_id;
-			msg->length = buffer.get_back()->dlc;
-			for (uint8_t i = 0; i < buffer.get_back()->dlc; i++) msg->data[i] = buffer.get_back()->data[i];
-
-			buffer.pop();
-
-			return true;
-		}
+		return rx_queue.pop(*msg);
 	}
 }
 
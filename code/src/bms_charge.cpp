@@ -0,0 +1,264 @@
+/*
+ * bms_charge.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "bms_charge.hpp"
+#include "bms_state.hpp"
+#include "bms_adc.hpp"
+#include "bms_scheduler.hpp"
+#include "configuration.hpp"
+#include "fixed_point.hpp"
+#include "bms_trace.hpp"
+
+namespace charge
+{
+	phase_t phase = IDLE;
+	uint16_t current_limit = 0;
+	uint16_t limit_pauses = 0;
+}
+
+namespace
+{
+	/* Derating ramps (°C away from the end of the range to mA) */
+	constexpr uint32_t hot_span = bms_config::charging_temperature_max - bms_config::charging_temperature_high;
+	constexpr uint32_t cold_span = bms_config::temperature_low - bms_config::temperature_min;
+
+	typedef fixed::ratio<bms_config::charge_current_max, hot_span, hot_span> hot_derating;
+	typedef fixed::ratio<bms_config::charge_current_max, cold_span, cold_span> cold_derating;
+
+	static_assert(hot_derating::max_error == 0 && cold_derating::max_error == 0, "Inexact charge current derating");
+
+	/* Time (ms) of the last phase change */
+	uint32_t phase_since = 0;
+
+	/* Charge current over the limit since overlimit_since (ms) */
+	bool overlimit = false;
+	uint32_t overlimit_since = 0;
+
+	/* Pauses of the current charge, and charge current (mA) drawn when the last one started */
+	uint8_t pauses = 0;
+	uint16_t paused_current = 0;
+
+	void enter(charge::phase_t next)
+	{
+		charge::phase = next;
+		phase_since = scheduler::now();
+		trace::log<trace::CHARGE_PHASE>(next);
+	}
+
+	/*
+	 * Charge current limit of the hottest and coldest sensors (see bms_charge.hpp)
+	 */
+	uint16_t temperature_limit(void)
+	{
+		int16_t hottest = adc::temperature_readings[0];
+		int16_t coldest = adc::temperature_readings[0];
+		uint32_t limit = bms_config::charge_current_max;
+
+		for (int i=1; i<bms_config::n_temperature_sensors; ++i)
+		{
+			if (adc::temperature_readings[i] > hottest) hottest = adc::temperature_readings[i];
+			if (adc::temperature_readings[i] < coldest) coldest = adc::temperature_readings[i];
+		}
+
+		if (hottest >= bms_config::charging_temperature_max || coldest <= bms_config::temperature_min) return 0;
+
+		if (hottest > bms_config::charging_temperature_high)
+		{
+			uint32_t derated = hot_derating::apply(uint32_t(bms_config::charging_temperature_max - hottest));
+			if (derated < limit) limit = derated;
+		}
+		if (coldest < bms_config::temperature_low)
+		{
+			uint32_t derated = cold_derating::apply(uint32_t(coldest - bms_config::temperature_min));
+			if (derated < limit) limit = derated;
+		}
+
+		return uint16_t(limit);
+	}
+
+	/*
+	 * Charging may start: Delta is connected to the PCB (current next to changing sign), no error
+	 * is present and the battery voltage is below a pre-determined setpoint, in order to avoid
+	 * problems.
+	 */
+	bool start_conditions(void)
+	{
+		return bms_state == READY && monitor.battery_voltage <= bms_config::voltage_setpoint &&
+				adc::current_sense <= bms_config::charge_enable_threshold;
+	}
+
+	/*
+	 * The charger stopped, or the current tapered off at the end of the charge
+	 */
+	bool current_stopped(void)
+	{
+		return adc::current_sense >= bms_config::charge_stop_threshold;
+	}
+
+	/*
+	 * Exit from CHARGE state (opens the FETs, closed again by the main loop as check is set)
+	 */
+	void finish(void)
+	{
+		trace::log<trace::CHARGE_FINISHED>();
+		state::set_state(READY);
+		in_charge = false;
+		check = true;
+		enter(charge::IDLE);
+	}
+
+	/*
+	 * Opens the FETs (CHARGE state kept, so status_encoder doesn't close them), or ends the
+	 * charge after too many pauses
+	 */
+	void pause(void)
+	{
+		int32_t charging = -int32_t(adc::current_sense);
+
+		if (++pauses > bms_config::charge_max_pauses)
+		{
+			finish();
+			return;
+		}
+
+		monitor.write_register(sys_ctrl2, monitor.FET_DISABLE);
+		overlimit = false;
+		paused_current = uint16_t(charging < 0 ? 0 : (charging > UINT16_MAX ? UINT16_MAX : charging));
+		enter(charge::PAUSED);
+	}
+
+	/*
+	 * Pauses the charge when the temperature is out of range, or when the charger keeps
+	 * going over the current limit
+	 */
+	void check_limit(void)
+	{
+		if (charge::current_limit == 0)
+		{
+			/* Out of the charging range, the charger current doesn't matter to resume */
+			pause();
+			paused_current = 0;
+		}
+		else if (-int32_t(adc::current_sense) > int32_t(charge::current_limit) + bms_config::charge_limit_margin)
+		{
+			if (!overlimit)
+			{
+				overlimit = true;
+				overlimit_since = scheduler::now();
+			}
+			else if (scheduler::now() - overlimit_since >= bms_config::charge_overlimit_time)
+			{
+				if (charge::limit_pauses < UINT16_MAX) charge::limit_pauses++;
+				pause();
+			}
+		}
+		else
+		{
+			overlimit = false;
+		}
+	}
+}
+
+namespace charge
+{
+	void reset()
+	{
+		phase = IDLE;
+		in_charge = false;
+		overlimit = false;
+	}
+
+	void step()
+	{
+		current_limit = temperature_limit();
+
+		/* An error state took over: its entry action has already handled the FETs */
+		if (phase >= CONSTANT_CURRENT && bms_state != CHARGE && bms_state != CHARGE_AND_BAL)
+		{
+			trace::log<trace::CHARGE_ABORTED>(bms_state);
+			in_charge = false;
+			enter(IDLE);
+			return;
+		}
+
+		/* Balancing done while charging */
+		if (bms_state == CHARGE_AND_BAL && !monitor.balancing_enabled)
+		{
+			state::set_state(CHARGE);
+		}
+
+		switch (phase)
+		{
+		case IDLE:
+			if (start_conditions()) enter(PENDING);
+			break;
+
+		case PENDING:
+			/* This allows for disconnecting the charger whenever charging has finished
+			 * and not re-enter charging right after. This applies whenever the setpoint is lower
+			 * than the maximum LVB voltage or when the current doesn't go below the required setpoint */
+			if (!start_conditions())
+			{
+				enter(IDLE);
+			}
+			else if (scheduler::now() - phase_since >= bms_config::charging_debounce)
+			{
+				trace::log<trace::CHARGE_INITIATED>();
+				in_charge = true;
+				overlimit = false;
+				pauses = 0;
+				/* Entering CHARGE signals charging procedure (see the transition matrix) */
+				state::set_state(CHARGE);
+				enter(CONSTANT_CURRENT);
+			}
+			break;
+
+		case CONSTANT_CURRENT:
+			if (current_stopped())
+			{
+				finish();
+			}
+			else if (monitor.max_voltage >= bms_config::charge_cv_voltage || monitor.battery_voltage >= bms_config::voltage_setpoint)
+			{
+				enter(CONSTANT_VOLTAGE);
+			}
+			else
+			{
+				check_limit();
+			}
+			break;
+
+		case CONSTANT_VOLTAGE:
+			if (current_stopped())
+			{
+				finish();
+			}
+			else
+			{
+				check_limit();
+			}
+			break;
+
+		case PAUSED:
+			/* No current flows while paused, so an unplugged charger can't be told apart: give up
+			 * after a while. Otherwise resume once the limit covers the current the charger was
+			 * drawing, with some hysteresis in time */
+			if (scheduler::now() - phase_since >= bms_config::charge_pause_timeout)
+			{
+				finish();
+			}
+			else if (current_limit > paused_current && scheduler::now() - phase_since >= bms_config::charge_pause_time)
+			{
+				monitor.write_register(sys_ctrl2, monitor.FET_ON);
+				enter(CONSTANT_CURRENT);
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
@@ -0,0 +1,105 @@
+/*
+ * bms_events.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "bms_events.hpp"
+#include "pins.hpp"
+#include "BQ76930.hpp"
+
+namespace
+{
+	static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0, "Event queue size must be a power of 2");
+	static_assert(EVENT_QUEUE_SIZE >= events::N_EVENTS, "Event queue shorter than the events");
+
+	volatile events::event_t queue[EVENT_QUEUE_SIZE];
+	volatile uint8_t head = 0;
+	volatile uint8_t tail = 0;
+
+	/* Events waiting in the queue, one bit each */
+	volatile uint32_t queued = 0;
+}
+
+namespace events
+{
+	void init()
+	{
+		/* Button presses (rising edge) and LVB connection changes (both edges) */
+		gpio::enable_interrupt(pin::wakeup, true);
+		gpio::enable_interrupt_edges(pin::sense_pos);
+		gpio::enable_interrupt_edges(pin::sense_neg);
+		NVIC_ClearPendingIRQ(EINT0_IRQn);
+		NVIC_EnableIRQ(EINT0_IRQn);
+
+		post(SENSE);
+	}
+
+	void post(event_t event)
+	{
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+
+		if (!(queued & (1UL << event)))
+		{
+			queued |= 1UL << event;
+			queue[head] = event;
+			head = (head + 1) & (EVENT_QUEUE_SIZE - 1);
+		}
+
+		__set_PRIMASK(primask);
+	}
+
+	event_t wait()
+	{
+		event_t event;
+
+		/*
+		 * The queue is checked with the interrupts masked: __WFI still returns as soon as an
+		 * interrupt is pending, which is then served when they're unmasked. An event posted
+		 * between the check and __WFI can't be missed this way.
+		 */
+		__disable_irq();
+		while (head == tail)
+		{
+			__WFI();
+			__enable_irq();
+			__disable_irq();
+		}
+
+		event = queue[tail];
+		tail = (tail + 1) & (EVENT_QUEUE_SIZE - 1);
+		queued &= ~(1UL << event);
+		__enable_irq();
+
+		return event;
+	}
+}
+
+/*
+ * Port 0 pin interrupt handler (needs extern "C" declaration to properly work)
+ * ALERT (PIO0_2), wakeup button (PIO0_6) and sense pins (PIO0_8, PIO0_9) are
+ * configured as interrupt sources on port 0.
+ */
+extern "C" __attribute__ ((interrupt)) void PIOINT0_IRQHandler(void)
+{
+	bool sense = false;
+
+	if (gpio::clear_interrupt(pin::ALERT))
+	{
+		afe_alert_interrupt();
+		events::post(events::ALERT);
+	}
+	if (gpio::clear_interrupt(pin::wakeup))
+	{
+		events::post(events::BUTTON);
+	}
+
+	/* Both pins are always cleared */
+	sense |= gpio::clear_interrupt(pin::sense_pos);
+	sense |= gpio::clear_interrupt(pin::sense_neg);
+	if (sense)
+	{
+		events::post(events::SENSE);
+	}
+}
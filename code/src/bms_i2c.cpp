@@ -6,6 +6,72 @@
  */
 
 #include "bms_i2c.hpp"
+#include "bms_events.hpp"
+
+/*
+ * Master transfer state machine of the LPC library (i2c_11xx.c).
+ * It's not exported by the library header, but it's exactly what's needed to move
+ * a transfer forward from the interrupt handler without the blocking WAIT event.
+ * Returns 0 as soon as the transfer has been stopped.
+ */
+extern "C" int handleMasterXferState(LPC_I2C_T *pI2C, I2C_XFER_T *xfer);
+
+namespace
+{
+	/*
+	 * Queue of the pending transactions.
+	 * queue[read_index] is the transaction currently on the bus (if any)
+	 */
+	i2c::transaction *queue[I2C_QUEUE_SIZE];
+	volatile uint8_t read_index = 0;
+	volatile uint8_t write_index = 0;
+
+	inline bool queue_empty()
+	{
+		return read_index == write_index;
+	}
+
+	/*
+	 * Prepares the working copy of the transfer and issues the START condition.
+	 * Same steps of the library startMasterXfer(), but only after the STOP condition
+	 * of the previous transfer has left the bus.
+	 */
+	void start(i2c::transaction *t)
+	{
+		t->xfer.slaveAddr = t->address;
+		t->xfer.txBuff = t->send_data;
+		t->xfer.txSz = t->send_size;
+		t->xfer.rxBuff = t->receive_data;
+		t->xfer.rxSz = t->receive_size;
+		t->xfer.status = I2C_STATUS_BUSY;
+
+		while (LPC_I2C->CONSET & I2C_CON_STO) {}
+
+		LPC_I2C->CONCLR = I2C_CON_SI | I2C_CON_STO | I2C_CON_STA | I2C_CON_AA;
+		LPC_I2C->CONSET = I2C_CON_I2EN | I2C_CON_STA;
+	}
+
+	/*
+	 * Fills in the results, signals completion and starts the next queued transaction
+	 */
+	void complete(i2c::transaction *t)
+	{
+		t->sent = t->send_size - t->xfer.txSz;
+		t->received = t->receive_size - t->xfer.rxSz;
+		t->status = t->xfer.status;
+
+		read_index = (read_index + 1) & (I2C_QUEUE_SIZE - 1);
+
+		t->done = true;
+		if (t->callback) t->callback(t);
+		events::post(events::I2C_DONE);
+
+		if (!queue_empty())
+		{
+			start(queue[read_index]);
+		}
+	}
+}
 
 namespace i2c
 {
@@ -26,35 +92,116 @@ namespace i2c
 		Chip_IOCON_PinMuxSet(LPC_IOCON, I2C_SCL, IOCON_FUNC1 | IOCON_MODE_PULLUP | IOCON_OPENDRAIN_EN);
 		Chip_IOCON_PinMuxSet(LPC_IOCON, I2C_SDA, IOCON_FUNC1 | IOCON_MODE_PULLUP | IOCON_OPENDRAIN_EN);
 
-		Chip_I2C_SetMasterEventHandler(id, Chip_I2C_EventHandler);
+		/* Peripheral has been reset, drop whatever was still queued */
+		read_index = 0;
+		write_index = 0;
+
 		NVIC_EnableIRQ(I2C0_IRQn);
 	}
 
 	int send(I2C_ID_T id, uint8_t address, size_t send_size, uint8_t send_data[])
 	{
-		return Chip_I2C_MasterSend(id, address, send_data, send_size);
+		return transceive(id, address, send_size, send_data, 0, 0);
 	}
 
-	int receive(I2C_ID_T id, uint8_t address, size_t receive_size, uint8_t receive_data[])
+	int receive(__attribute__ ((unused)) I2C_ID_T id, uint8_t address, size_t receive_size, uint8_t receive_data[])
 	{
-		return Chip_I2C_MasterRead(id, address, receive_data, receive_size);
+		transaction t = {};
+		t.address = address;
+		t.receive_data = receive_data;
+		t.receive_size = receive_size;
+
+		if (!submit(&t)) return 0;
+		wait(&t);
+
+		return t.received;
 	}
 
-	int transceive(I2C_ID_T id, uint8_t address, size_t send_size, uint8_t send_data[], size_t receive_size, uint8_t receive_data[])
+	int transceive(__attribute__ ((unused)) I2C_ID_T id, uint8_t address, size_t send_size, uint8_t send_data[], size_t receive_size, uint8_t receive_data[])
 	{
-		I2C_XFER_T xfer;
-		xfer.slaveAddr = address;
-		xfer.txBuff = send_data;
-		xfer.rxBuff = receive_data;
-		xfer.txSz = send_size;
-		xfer.rxSz = receive_size;
-
-		return Chip_I2C_MasterTransfer(id, &xfer);
+		transaction t = {};
+		t.address = address;
+		t.send_data = send_data;
+		t.send_size = send_size;
+		t.receive_data = receive_data;
+		t.receive_size = receive_size;
+
+		if (!submit(&t)) return 0;
+		wait(&t);
+
+		/* Same return value of the LPC library functions (bytes transferred) */
+		return receive_size ? t.received : t.sent;
 	}
 
 	int command_read(I2C_ID_T id, uint8_t address, uint8_t command, size_t size, uint8_t data[])
 	{
-		return Chip_I2C_MasterCmdRead(id, address, command, data, size);
+		return transceive(id, address, 1, &command, size, data);
+	}
+
+	bool submit(transaction *t)
+	{
+		bool submitted = false;
+
+		t->done = false;
+		t->status = I2C_STATUS_BUSY;
+		t->retries = 0;
+		t->sent = 0;
+		t->received = 0;
+
+		/* Transactions may also be submitted by completion callbacks (ISR) */
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		uint8_t next = (write_index + 1) & (I2C_QUEUE_SIZE - 1);
+		if (next != read_index)
+		{
+			bool was_idle = queue_empty();
+
+			queue[write_index] = t;
+			write_index = next;
+			submitted = true;
+
+			if (was_idle) start(t);
+		}
+		__set_PRIMASK(primask);
+
+		return submitted;
+	}
+
+	I2C_STATUS_T wait(transaction *t)
+	{
+		/* Wait for the interrupt handler to complete the transaction (loop intentionally left void) */
+		while (!t->done) {}
+
+		return t->status;
+	}
+
+	bool is_idle()
+	{
+		return queue_empty();
+	}
+
+	void state_handler()
+	{
+		if (queue_empty())
+		{
+			/* Spurious interrupt, nothing to do but releasing the bus */
+			LPC_I2C->CONCLR = I2C_CON_SI;
+			return;
+		}
+
+		transaction *t = queue[read_index];
+
+		if (handleMasterXferState(LPC_I2C, &t->xfer) == 0)
+		{
+			/* Arbitration lost: restart the very same transaction */
+			if (t->xfer.status == I2C_STATUS_ARBLOST && t->retries++ < I2C_MAX_RETRIES)
+			{
+				start(t);
+				return;
+			}
+
+			complete(t);
+		}
 	}
 }
 
@@ -63,5 +210,5 @@ namespace i2c
  */
 extern "C" __attribute__ ((interrupt)) void I2C_IRQHandler(void)
 {
-	Chip_I2C_MasterStateHandler(I2C0);
+	i2c::state_handler();
 }
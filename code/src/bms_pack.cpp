@@ -0,0 +1,201 @@
+/*
+ * bms_pack.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "bms_pack.hpp"
+
+/* Cell voltages reads of all the AFEs (with their mux selection) are queued at once */
+static_assert(2 * bms_config::n_afe < I2C_QUEUE_SIZE, "I2C queue too small for the AFEs of the pack");
+
+void BMS_pack::init(void)
+{
+	/* One bus and one transaction queue shared by all the AFEs */
+	i2c::init(I2C_INTERFACE, I2C_SPEED);
+
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].init(bms_config::afe_address[i], bms_config::afe_mux_channel[i]);
+	}
+
+	update_error();
+}
+
+uint8_t BMS_pack::read_status(void)
+{
+	uint8_t status = 0;
+
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe_status[i] = afe[i].error_bit ? 0 : afe[i].read_register(sys_stat);
+		status |= afe_status[i];
+	}
+
+	update_error();
+
+	return status;
+}
+
+void BMS_pack::start_cellvoltages(void)
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].start_cellvoltages();
+	}
+}
+
+bool BMS_pack::cellvoltages_done(void)
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		if (!afe[i].cellvoltages_done()) return false;
+	}
+
+	return true;
+}
+
+void BMS_pack::read_cellvoltages(void)
+{
+	/* Make sure every read is queued before waiting for the first one */
+	start_cellvoltages();
+
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].read_cellvoltages();
+
+		for (int cell=0; cell<bms_config::n_cells; ++cell)
+		{
+			voltage_readings[i * bms_config::n_cells + cell] = afe[i].voltage_readings[cell];
+		}
+	}
+
+	statistics();
+	update_error();
+}
+
+void BMS_pack::statistics(void)
+{
+	typedef fixed::ratio<1, bms_config::pack_cells, bms_config::pack_cells * BQ76930::MAX_CELL_VOLTAGE> average;
+	static_assert(average::max_error == 0, "Inexact pack voltage average");
+
+	uint32_t sum = 0;
+
+	min_voltage = voltage_readings[0];
+	max_voltage = voltage_readings[0];
+
+	for (int cell=0; cell<bms_config::pack_cells; ++cell)
+	{
+		if (voltage_readings[cell] < min_voltage) min_voltage = voltage_readings[cell];
+		if (voltage_readings[cell] > max_voltage) max_voltage = voltage_readings[cell];
+		sum += voltage_readings[cell];
+	}
+
+	avg_voltage = uint16_t(average::apply(sum));
+}
+
+void BMS_pack::read_battery_voltage(void)
+{
+	uint32_t voltage = 0;
+
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].read_battery_voltage();
+		voltage += afe[i].battery_voltage;
+	}
+
+	battery_voltage = voltage;
+	update_error();
+}
+
+void BMS_pack::init_stateofcharge(uint16_t capacity, int16_t initial_soc)
+{
+	afe[0].init_stateofcharge(capacity, initial_soc);
+	state_of_charge = afe[0].state_of_charge;
+}
+
+void BMS_pack::read_stateofcharge(void)
+{
+	if (!(afe_status[0] & CC_READY)) return;
+
+	afe[0].read_stateofcharge();
+	state_of_charge = afe[0].state_of_charge;
+	cc_current = afe[0].cc_current;
+
+	update_error();
+}
+
+bool BMS_pack::balancing_stop_condition(void)
+{
+	for (int cell=0; cell<bms_config::pack_cells; ++cell)
+	{
+		if (voltage_readings[cell] - min_voltage >= bms_config::balancing_stop) return false;
+	}
+
+	return true;
+}
+
+void BMS_pack::check_balancing(bool activate)
+{
+	if (activate)
+	{
+		for (int i=0; i<bms_config::n_afe; ++i)
+		{
+			/* Balance against the lowest cell of the whole pack */
+			afe[i].min_voltage = min_voltage;
+			afe[i].balancing_enabled = true;
+			afe[i].check_balancing(true);
+		}
+	}
+	else if (balancing_enabled && balancing_stop_condition())
+	{
+		for (int i=0; i<bms_config::n_afe; ++i)
+		{
+			afe[i].disable_balancing();
+		}
+		balancing_enabled = false;
+	}
+
+	update_error();
+}
+
+void BMS_pack::write_register(const TI_Register_ID reg, uint8_t data, bool force)
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].write_register(reg, data, force);
+	}
+
+	update_error();
+}
+
+void BMS_pack::clear_status(uint8_t mask)
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		/* Writing 0 wouldn't clear anything */
+		uint8_t bits = afe_status[i] & mask;
+
+		if (bits != 0) afe[i].write_register(sys_stat, bits);
+	}
+
+	update_error();
+}
+
+void BMS_pack::invalidate_register(const TI_Register_ID reg)
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].invalidate_register(reg);
+	}
+}
+
+void BMS_pack::check_registers(void)
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		afe[i].check_registers();
+	}
+
+	update_error();
+}
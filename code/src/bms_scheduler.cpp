@@ -0,0 +1,167 @@
+/*
+ * bms_scheduler.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "bms_scheduler.hpp"
+#include "bms_events.hpp"
+
+namespace
+{
+	scheduler::task *tasks = nullptr;
+	int n_tasks = 0;
+
+	/* Milliseconds counted by SysTick, and earliest release of the table */
+	volatile uint32_t milliseconds = 0;
+	volatile uint32_t next_release = 0;
+
+	/* SysTick cycles in a millisecond and in a microsecond */
+	uint32_t cycles_per_ms = 0;
+	uint32_t cycles_per_us = 0;
+
+	/* TRUE if time \t has been reached at time \time */
+	inline bool reached(uint32_t t, uint32_t time)
+	{
+		return int32_t(time - t) >= 0;
+	}
+
+	/*
+	 * Core clock cycles since init() (wraps every 89s at 48MHz, differences only).
+	 * A SysTick reload not served yet (interrupts masked, or a higher priority running)
+	 * is accounted for with the pending flag.
+	 */
+	uint32_t timestamp()
+	{
+		uint32_t primask = __get_PRIMASK();
+		uint32_t ms;
+		uint32_t value;
+
+		__disable_irq();
+		ms = milliseconds;
+		value = SysTick->VAL;
+		if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+		{
+			ms++;
+			value = SysTick->VAL;
+		}
+		__set_PRIMASK(primask);
+
+		return ms * cycles_per_ms + (cycles_per_ms - 1 - value);
+	}
+
+	/*
+	 * Earliest release of the table (possibly already reached, while the tasks run)
+	 */
+	void update_next_release()
+	{
+		uint32_t time = milliseconds;
+		uint32_t next = tasks[0].release;
+
+		for (int i=1; i<n_tasks; ++i)
+		{
+			if (int32_t(tasks[i].release - time) < int32_t(next - time)) next = tasks[i].release;
+		}
+
+		next_release = next;
+	}
+}
+
+namespace scheduler
+{
+	void init(task *table, int count)
+	{
+		tasks = table;
+		n_tasks = count;
+
+		cycles_per_ms = Chip_Clock_GetSystemClockRate() / 1000;
+		cycles_per_us = cycles_per_ms / 1000;
+
+		milliseconds = 0;
+		for (int i=0; i<n_tasks; ++i)
+		{
+			tasks[i].release = tasks[i].phase;
+			tasks[i].budget_cycles = tasks[i].budget * cycles_per_us;
+			tasks[i].worst = 0;
+			tasks[i].overruns = 0;
+			tasks[i].skipped = 0;
+		}
+		update_next_release();
+
+		start();
+	}
+
+	void start()
+	{
+		SysTick->LOAD = cycles_per_ms - 1;
+		SysTick->VAL = 0;
+		SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+	}
+
+	uint32_t now()
+	{
+		return milliseconds;
+	}
+
+	void run()
+	{
+		for (int i=0; i<n_tasks; ++i)
+		{
+			task &t = tasks[i];
+			uint32_t start;
+			uint32_t elapsed;
+
+			if (!reached(t.release, milliseconds)) continue;
+
+			/* Next release from the previous one, not from now: no drift */
+			t.release += t.period;
+			while (reached(t.release, milliseconds))
+			{
+				t.release += t.period;
+				if (t.skipped < UINT16_MAX) t.skipped++;
+			}
+
+			start = timestamp();
+			t.run();
+			elapsed = timestamp() - start;
+
+			if (elapsed > t.worst) t.worst = elapsed;
+			if (elapsed > t.budget_cycles && t.overruns < UINT16_MAX) t.overruns++;
+		}
+
+		/* A task released while the others were running is served right away */
+		__disable_irq();
+		update_next_release();
+		if (reached(next_release, milliseconds)) events::post(events::TICK);
+		__enable_irq();
+	}
+
+	const task *table()
+	{
+		return tasks;
+	}
+
+	int size()
+	{
+		return n_tasks;
+	}
+
+	uint32_t worst_time(const task &t)
+	{
+		return t.worst / cycles_per_us;
+	}
+}
+
+/*
+ * SysTick interrupt handler (needs extern "C" declaration to properly work)
+ * Counts the milliseconds and wakes up the main loop only when a task is due.
+ */
+extern "C" __attribute__ ((interrupt)) void SysTick_Handler(void)
+{
+	milliseconds++;
+
+	if (reached(next_release, milliseconds))
+	{
+		events::post(events::TICK);
+	}
+}
@@ -9,6 +9,8 @@
 #include "bms_gpio.hpp"
 #include "bms_uart.hpp"
 #include "pins.hpp"
+#include "bms_scheduler.hpp"
+#include "bms_charge.hpp"
 
 #include "SEGGER_RTT.h"
 
@@ -17,24 +19,252 @@ namespace state
 	/* OV counter used to disable (open) DSG FET in case of persitent fault condition */
 	int OV_counter = 0;
 
-	/* Pre-defined valid state transitions */
-	state_transition valid_state_transitions[10] =
+	namespace
 	{
-			{ SETUP 		, READY			},
-			{ READY 		, CHARGE 		},
-			{ CHARGE 		, READY 		},
-			{ READY 		, BALANCING 	},
-			{ BALANCING 	, READY 		},
-			{ READY 		, SLEEP			},
-			{ SLEEP 		, SETUP 		},
-			{ CHARGE		, CHARGE_AND_BAL},
-			{ CHARGE_AND_BAL, CHARGE 		}
-	};
+		/* LEDs switched by the actions, one bit each */
+		enum led : uint8_t
+		{
+			LED_OK		= 0x01,
+			LED_ERROR	= 0x02,
+			LED_OV		= 0x04,
+			LED_UV		= 0x08,
+			LED_OC		= 0x10,
+			LED_OT		= 0x20,
+			LED_UT		= 0x40,
+			LED_ALL		= 0x7F
+		};
+
+		/* FET command of an action (closing the FETs is left to the main loop) */
+		enum fet_command : uint8_t
+		{
+			FET_KEEP,
+			FET_OPEN
+		};
+
+		/*
+		 * Action run on a transition: LEDs switched on/off and FET command.
+		 * It applies only when the other end of the transition is in peers: the old state for
+		 * entry actions, the new state for exit actions.
+		 */
+		struct action
+		{
+			uint16_t peers;
+			uint8_t leds_on;
+			uint8_t leds_off;
+			fet_command fet;
+		};
+
+		/*
+		 * Row of the transition matrix: states reachable from this one (bitmask of compact
+		 * indices) and the actions run when entering and leaving it
+		 */
+		struct state_descriptor
+		{
+			state_t state;
+			uint16_t targets;
+			action entry;
+			action exit;
+		};
+
+		/* Compact index of every state, the order of the rows below */
+		constexpr state_t states[] =
+		{
+				SETUP, SLEEP, READY, CHARGE, BALANCING, CHARGE_AND_BAL,
+				OVERCURRENT, SHORTCIRCUIT, OVERVOLTAGE, UNDERVOLTAGE, AFE_FAULT, I2C_FAIL,
+				ERR_TRANSIENT, ILLEGAL_STATE, OVERTEMPERATURE, UNDERTEMPERATURE
+		};
+		constexpr int n_states = sizeof(states) / sizeof(states[0]);
+
+		static_assert(n_states <= 16, "Transition masks are 16 bits");
+
+		/* Bit of a state in the masks (compile time only, see index_table for the lookup) */
+		constexpr uint16_t bit(state_t state)
+		{
+			for (int i=0; i<n_states; ++i)
+			{
+				if (states[i] == state) return uint16_t(1 << i);
+			}
+			return 0;
+		}
+
+		constexpr uint16_t ANY 				= 0xFFFF;
+		/* Errors reported by the AFE, they recover after persisting (see status_encoder) */
+		constexpr uint16_t AFE_ERRORS 		= bit(OVERCURRENT) | bit(SHORTCIRCUIT) | bit(OVERVOLTAGE) | bit(AFE_FAULT) |
+											  bit(I2C_FAIL) | bit(ERR_TRANSIENT);
+		/* Errors the BMS doesn't recover from: they're only left when the LVB is disconnected (SLEEP) */
+		constexpr uint16_t UNRECOVERABLE	= bit(UNDERVOLTAGE) | bit(ILLEGAL_STATE) | bit(OVERTEMPERATURE) | bit(UNDERTEMPERATURE);
+		/* Every error, reachable from any recoverable state */
+		constexpr uint16_t ERRORS 			= AFE_ERRORS | UNRECOVERABLE;
+
+		constexpr action NONE 				= { ANY, 0, 0, FET_KEEP };
+
+		/*
+		 * Transition matrix.
+		 * Every state can go to SLEEP (the chip goes to deep sleep whatever the state).
+		 * Errors are reachable from every state and can be replaced by later errors, or left
+		 * when the LVB is disconnected (SLEEP). Only the AFE errors go back to READY:
+		 * UV, OT, UT and ILLEGAL_STATE are unrecoverable, they only lead to each other or to SLEEP.
+		 */
+		constexpr state_descriptor descriptors[n_states] =
+		{
+				/* State			Targets													Entry												Exit */
+				{ SETUP,			bit(READY) | bit(SLEEP) | ERRORS,						{ bit(SLEEP), LED_ALL, 0, FET_KEEP },				NONE },
+				{ SLEEP,			bit(SETUP) | ERRORS,									{ ANY, 0, LED_ALL, FET_KEEP },						NONE },
+				{ READY,			bit(CHARGE) | bit(BALANCING) | bit(SLEEP) | ERRORS,		NONE,												NONE },
+				{ CHARGE,			bit(READY) | bit(CHARGE_AND_BAL) | bit(SLEEP) | ERRORS,	{ ANY, LED_UT, 0, FET_KEEP },						{ bit(READY), 0, LED_UT, FET_OPEN } },
+				{ BALANCING,		bit(READY) | bit(SLEEP) | ERRORS,						{ ANY, LED_UT | LED_UV, 0, FET_KEEP },				NONE },
+				{ CHARGE_AND_BAL,	bit(CHARGE) | bit(READY) | bit(SLEEP) | ERRORS,			{ ANY, LED_UT | LED_UV, 0, FET_KEEP },				{ bit(READY), 0, LED_UT, FET_OPEN } },
+				{ OVERCURRENT,		bit(READY) | bit(SLEEP) | ERRORS,						{ ANY, LED_OC, 0, FET_KEEP },						NONE },
+				{ SHORTCIRCUIT,		bit(READY) | bit(SLEEP) | ERRORS,						{ ANY, LED_OC, 0, FET_KEEP },						NONE },
+				{ OVERVOLTAGE,		bit(READY) | bit(SLEEP) | ERRORS,						{ ANY, LED_OV, 0, FET_OPEN },						NONE },
+				{ UNDERVOLTAGE,		bit(SLEEP) | UNRECOVERABLE,								{ ANY, LED_UV, 0, FET_KEEP },						NONE },
+				{ AFE_FAULT,		bit(READY) | bit(SLEEP) | ERRORS,						{ ANY, LED_ERROR, 0, FET_KEEP },					NONE },
+				{ I2C_FAIL,			bit(READY) | bit(SLEEP) | ERRORS,						{ ANY, LED_OK | LED_ERROR | LED_OV, 0, FET_KEEP },	NONE },
+				{ ERR_TRANSIENT,	bit(READY) | bit(SLEEP) | ERRORS,						NONE,												NONE },
+				{ ILLEGAL_STATE,	bit(SLEEP) | UNRECOVERABLE,								NONE,												NONE },
+				{ OVERTEMPERATURE,	bit(SLEEP) | UNRECOVERABLE,								{ ANY, LED_OT, 0, FET_OPEN },						NONE },
+				{ UNDERTEMPERATURE,	bit(SLEEP) | UNRECOVERABLE,								{ ANY, LED_UT, 0, FET_OPEN },						NONE }
+		};
+
+		/* Compact index of every state_t value (n_states if it isn't a state) */
+		struct index_table
+		{
+			uint8_t of[256];
+
+			constexpr index_table() : of{}
+			{
+				for (int value=0; value<256; ++value)
+				{
+					of[value] = uint8_t(n_states);
+				}
+				for (int i=0; i<n_states; ++i)
+				{
+					of[states[i]] = uint8_t(i);
+				}
+			}
+		};
+
+		constexpr index_table state_index = index_table();
+
+		constexpr bool rows_in_order()
+		{
+			for (int i=0; i<n_states; ++i)
+			{
+				if (descriptors[i].state != states[i]) return false;
+			}
+			return true;
+		}
+
+		static_assert(rows_in_order(), "Transition matrix rows must follow the compact indices");
+
+		constexpr bool allowed(state_t old_state, state_t new_state)
+		{
+			return state_index.of[old_state] < n_states && state_index.of[new_state] < n_states &&
+					(old_state == new_state || (descriptors[state_index.of[old_state]].targets & (1 << state_index.of[new_state])) != 0);
+		}
+
+		static_assert(allowed(SETUP, READY) && allowed(CHARGE_AND_BAL, CHARGE) && allowed(CHARGE, CHARGE), "Missing transition");
+		static_assert(!allowed(SLEEP, CHARGE) && !allowed(OVERTEMPERATURE, READY) && !allowed(UNDERVOLTAGE, READY), "Unexpected transition");
+
+		/*
+		 * States reachable from \from in any number of transitions, without going through SLEEP
+		 */
+		constexpr uint16_t reachable(state_t from)
+		{
+			uint16_t found = uint16_t(1 << state_index.of[from]);
+
+			for (int round=0; round<n_states; ++round)
+			{
+				for (int i=0; i<n_states; ++i)
+				{
+					if ((found & (1 << i)) && states[i] != SLEEP) found |= descriptors[i].targets;
+				}
+			}
+
+			return found;
+		}
+
+		constexpr bool sleep_from_everywhere()
+		{
+			for (int i=0; i<n_states; ++i)
+			{
+				if (!allowed(states[i], SLEEP)) return false;
+			}
+			return true;
+		}
+
+		static_assert(sleep_from_everywhere(), "Every state must be able to go to SLEEP");
+		static_assert(!(reachable(UNDERVOLTAGE) & bit(READY)) && !(reachable(ILLEGAL_STATE) & bit(READY)) &&
+				!(reachable(OVERTEMPERATURE) & bit(READY)) && !(reachable(UNDERTEMPERATURE) & bit(READY)),
+				"Unrecoverable errors must not lead back to READY");
+
+		/* LED pins, in the order of the led bits */
+		gpio::pin *const leds[] =
+		{
+				&pin::OK_LED, &pin::ERROR_LED, &pin::OV_ERROR, &pin::UV_ERROR, &pin::OC_ERROR, &pin::OT_ERROR, &pin::UT_ERROR
+		};
+
+		/*
+		 * Runs an action, if it applies to the other end of the transition
+		 */
+		void run(const action &step, state_t peer)
+		{
+			if (!(step.peers & (1 << state_index.of[peer]))) return;
+
+			for (int i=0; i<int(sizeof(leds) / sizeof(leds[0])); ++i)
+			{
+				if (step.leds_off & (1 << i)) gpio::clear(*leds[i]);
+				if (step.leds_on & (1 << i)) gpio::set(*leds[i]);
+			}
+
+			if (step.fet == FET_OPEN)
+			{
+				monitor.write_register(sys_ctrl2, monitor.FET_DISABLE);
+			}
+		}
+
+		/*
+		 * AFE error read from SYS_STAT: it doesn't replace an unrecoverable error (that would
+		 * be an illegal transition), which already keeps the BMS from going back to READY
+		 */
+		void afe_error(state_t error)
+		{
+			if (allowed(bms_state, error)) set_state(error);
+		}
+	}
+
+	bool is_valid_transition(state_t old_state, state_t new_state)
+	{
+		return allowed(old_state, new_state);
+	}
+
+	void set_state(state_t new_state)
+	{
+		state_t old_state = bms_state;
+
+		if (!allowed(old_state, new_state))
+		{
+			bms_state = ILLEGAL_STATE;
+			return;
+		}
+
+		if (old_state != new_state)
+		{
+			run(descriptors[state_index.of[old_state]].exit, new_state);
+		}
+
+		bms_state = new_state;
+		run(descriptors[state_index.of[new_state]].entry, old_state);
+	}
 
 	void status_encoder()
 	{
-		uint8_t status = 0;
+		/* SYS_STAT is not read out if the I2C communication subsystem doesn't work */
+		status_encoder(monitor.read_status());
+	}
 
+	void status_encoder(uint8_t status)
+	{
 		gpio::clear(pin::OK_LED);
 		gpio::clear(pin::ERROR_LED);
 		gpio::clear(pin::OV_ERROR);
@@ -49,17 +279,17 @@ namespace state
 		/* Verify that the I2C communication subsystem works */
 		if (monitor.error_bit)
 		{
-			set_state(I2C_FAIL);
-
-			gpio::set(pin::OK_LED);
-			gpio::set(pin::ERROR_LED);
-			gpio::set(pin::OV_ERROR);
+			afe_error(I2C_FAIL);
 
 			/* Doesn't make sense to execute rest of the loop */
 			return;
 		}
 
-		status = monitor.read_register(sys_stat);
+		/* Upon faults the AFE opens the FETs by itself, sys_ctrl2 has to be written again */
+		if (status & 0x3F)
+		{
+			monitor.invalidate_register(sys_ctrl2);
+		}
 		switch(status & 0x7F)	/* Removes "CC_READY" option from the status reading */
 		{
 		case 0:		//OK
@@ -70,21 +300,20 @@ namespace state
 				monitor.write_register(sys_ctrl2, monitor.FET_ON);
 			}
 			/* Sanity assignment: if AFE is OK (and there's no OT/UT fault) set the state back to normal.
-			 * This avoids transient errors to be carried over */
-			if ((bms_state != OVERTEMPERATURE || bms_state != UNDERTEMPERATURE) && !in_charge && !monitor.balancing_enabled)
+			 * This avoids transient errors to be carried over (the unrecoverable ones are kept,
+			 * see the transition matrix) */
+			if (is_valid_transition(bms_state, READY) && !in_charge && !monitor.balancing_enabled)
 			{
 				set_state(READY);
 			}
 			break;
 
 		case 1:		//OCD
-			set_state(OVERCURRENT);
-			gpio::set(pin::OC_ERROR);
+			afe_error(OVERCURRENT);
 			break;
 
 		case 2:		//SCD
-			set_state(SHORTCIRCUIT);
-			gpio::set(pin::OC_ERROR);
+			afe_error(SHORTCIRCUIT);
 			break;
 
 		case 4:		//OV
@@ -95,27 +324,23 @@ namespace state
 			}
 			else
 			{
-				/* Open DSG FET (not automatically done by the AFE if OV fault */
-				monitor.write_register(sys_ctrl2, monitor.FET_DISABLE);
-				set_state(OVERVOLTAGE);
+				/* Opens DSG FET (not automatically done by the AFE if OV fault) */
+				afe_error(OVERVOLTAGE);
 			}
 			break;
 
 		case 6:		//OV + SCD
 			gpio::set(pin::OV_ERROR);
-			gpio::set(pin::OC_ERROR);
 			/* In this case, SCD has already triggered the AFE to open DSG FET */
-			set_state(OVERCURRENT);
+			afe_error(OVERCURRENT);
 			break;
 
 		case 8:		//UV
-			gpio::set(pin::UV_ERROR);
 			set_state(UNDERVOLTAGE);
 			break;
 
 		case 12:	//UV + OV
 			gpio::set(pin::OV_ERROR);
-			gpio::set(pin::UV_ERROR);
 			/* Usually transient, but can cause DSG_FET to open */
 			set_state(UNDERVOLTAGE);
 			/* If DSG FET is opened, then set state to UV (that's the error that
@@ -135,9 +360,8 @@ namespace state
 			break;
 
 		case 32:	//AFE_FAULT
-			gpio::set(pin::ERROR_LED);
 			/* No need to open the DSG FET manually */
-			set_state(AFE_FAULT);
+			afe_error(AFE_FAULT);
 			break;
 
 		default:
@@ -145,25 +369,24 @@ namespace state
 			break;
 		}
 
-		/* Clear system status */
-		monitor.write_register(sys_stat, status);
+		/* Clear system status, every AFE its own bits */
+		if (status != 0)
+		{
+			monitor.clear_status();
+		}
 	}
 
 	void enter_sleep_state()
 	{
-		/* Clears all LEDs to avoid power consumption, and to signal
+		/* Sets current BMS state to SLEEP (used for monitoring only).
+		 * Entering SLEEP clears all LEDs to avoid power consumption, and to signal
 		 * that Deep Sleep mode is initialized */
-		gpio::clear(pin::OK_LED);
-		gpio::clear(pin::ERROR_LED);
-		gpio::clear(pin::OV_ERROR);
-		gpio::clear(pin::UV_ERROR);
-		gpio::clear(pin::OC_ERROR);
-		gpio::clear(pin::OT_ERROR);
-		gpio::clear(pin::UT_ERROR);
-
-		/* Sets current BMS state to SLEEP (used for monitoring only) */
 		set_state(SLEEP);
 
+		/* The sampling timer and the event tick would wake the chip up right away */
+		adc::stop_sampling();
+		SysTick->CTRL = 0;
+
 		/* Set Rising Edge on all pins that have start logic enabled */
 		LPC_SYSCTL->STARTAPRP0 = 0x00000344;
 		/* Resets logic state of start logic input pins */
@@ -243,24 +466,18 @@ extern "C" __attribute__ ((interrupt)) void WAKEUP_IRQHandler(void)
 	/* __NOP() IS PLACED HERE AS DEFINED IN LPC11C24 PMU EXAMPLE */
 	__NOP();
 
+	/* Back to plain sleep for the __WFI of the event loop */
+	SCB->SCR &= ~(1<<2);
+
 	/* Disables the wakeup interrupts (to avoid INTR loop) */
 	//NVIC_DisableIRQ(PIO0_2_IRQn);
 	NVIC_DisableIRQ(PIO0_6_IRQn);
 	NVIC_DisableIRQ(PIO0_8_IRQn);
 	NVIC_DisableIRQ(PIO0_9_IRQn);
 
-	/* Set WAKEUP state as SETUP */
+	/* Set WAKEUP state as SETUP (entering SETUP from SLEEP sets all LEDs to signal the WAKEUP event) */
 	state::set_state(SETUP);
 
-	/* Set all LEDs to signal the WAKEUP event */
-	gpio::set(pin::OK_LED);
-	gpio::set(pin::ERROR_LED);
-	gpio::set(pin::OV_ERROR);
-	gpio::set(pin::UV_ERROR);
-	gpio::set(pin::OC_ERROR);
-	gpio::set(pin::OT_ERROR);
-	gpio::set(pin::UT_ERROR);
-
 	/* Initialize back all the peripherals */
 	SystemCoreClockUpdate();
 	pin::initialize_peripheral_pins();
@@ -269,15 +486,15 @@ extern "C" __attribute__ ((interrupt)) void WAKEUP_IRQHandler(void)
 	timing::init();
 	i2c::init(I2C_INTERFACE, I2C_SPEED);
 	uart::init();
+	scheduler::start();
+	events::init();
 
 	/* Initialize back all the global variables */
 	lvb_sense = true;
 	check = true;
-	deep_sleep_timer = 0;
-	can_update_counter = 0;
-	balancing_enabling_count = 0;
-	balancing_enabler = 0;
-	charging_enabling_count = 0;
+	disconnected_at = scheduler::now();
+	button_pressed_at = scheduler::now();
+	charge::reset();
 	monitor.balancing_enabled = false;
 }
 
@@ -0,0 +1,133 @@
+/*
+ * bms_trace.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "bms_trace.hpp"
+#include "bms_scheduler.hpp"
+#include "spsc_ring.hpp"
+
+#include "SEGGER_RTT.h"
+#include "SEGGER_RTT_Conf.h"
+
+namespace trace
+{
+	uint32_t dropped = 0;
+}
+
+namespace
+{
+	static_assert(TRACE_CHANNEL < SEGGER_RTT_MAX_NUM_UP_BUFFERS, "Trace channel not available");
+	static_assert(trace::N_MESSAGES <= 256, "Trace IDs are 1 byte");
+
+	constexpr int max_arguments()
+	{
+		int max = 0;
+
+		for (int i=0; i<trace::N_MESSAGES; ++i)
+		{
+			if (trace::arguments[i] > max) max = trace::arguments[i];
+		}
+
+		return max;
+	}
+
+	/* ID, time and arguments, up to 5 bytes each when encoded */
+	constexpr int max_record = 1 + 5 + 5 * max_arguments();
+
+	static_assert(max_record <= TRACE_QUEUE_SIZE, "Trace records don't fit in the queue");
+
+	/* RTT up-buffer, read by the host */
+	char buffer[TRACE_BUFFER_SIZE];
+
+	/* Records waiting to be copied to the up-buffer by flush() */
+	ring::spsc<uint8_t, TRACE_QUEUE_SIZE> queue;
+
+	/* Time (ms) of the last record written */
+	uint32_t last_time = 0;
+
+	/* Unsigned LEB128: 7 bits per byte, MSB set on all the bytes but the last */
+	inline uint8_t *encode(uint8_t *out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			*out++ = uint8_t(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = uint8_t(value);
+
+		return out;
+	}
+
+	/*
+	 * Encodes and queues a record, TRUE if there was room for the whole of it
+	 */
+	bool put(trace::id_t id, const int32_t *values, int n_values)
+	{
+		uint8_t record[max_record];
+		uint8_t *end = record;
+		uint32_t time = scheduler::now();
+
+		*end++ = id;
+		end = encode(end, time - last_time);
+		for (int i=0; i<n_values; ++i)
+		{
+			/* Zigzag: small magnitudes are short whatever their sign */
+			end = encode(end, (uint32_t(values[i]) << 1) ^ uint32_t(values[i] >> 31));
+		}
+
+		if (!queue.write(record, unsigned(end - record))) return false;
+
+		last_time = time;
+		return true;
+	}
+}
+
+namespace trace
+{
+	void init()
+	{
+		const int32_t version = TRACE_VERSION;
+
+		/* Never blocking: what doesn't fit stays in the queue until the next flush() */
+		SEGGER_RTT_ConfigUpBuffer(TRACE_CHANNEL, "Trace", buffer, TRACE_BUFFER_SIZE, SEGGER_RTT_MODE_NO_BLOCK_TRIM);
+
+		queue.clear();
+		last_time = scheduler::now();
+		dropped = 0;
+		put(TRACE_START, &version, 1);
+	}
+
+	void write(id_t id, const int32_t *values, int n_values)
+	{
+		if (dropped != 0)
+		{
+			const int32_t lost = int32_t(dropped);
+
+			if (!put(TRACE_DROPPED, &lost, 1))
+			{
+				dropped++;
+				return;
+			}
+			dropped = 0;
+		}
+
+		if (!put(id, values, n_values)) dropped++;
+	}
+
+	void flush()
+	{
+		const uint8_t *bytes;
+		unsigned count;
+
+		/* Twice at most, when the queued bytes wrap around the end of the queue */
+		while ((count = queue.contiguous(bytes)) != 0)
+		{
+			unsigned written = SEGGER_RTT_Write(TRACE_CHANNEL, reinterpret_cast<const char *>(bytes), count);
+
+			queue.release(written);
+			if (written < count) break;
+		}
+	}
+}
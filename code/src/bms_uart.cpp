@@ -6,19 +6,38 @@
  */
 #include "bms_uart.hpp"
 #include "pins.hpp"
+#include "spsc_ring.hpp"
 
-namespace uart
+namespace
 {
-	/* Transmit and Receive ring buffers */
-	RINGBUFF_T send_buffer;
-	RINGBUFF_T recv_buffer;
+	/* Depth of the UART hardware transmit FIFO */
+	const int hardware_fifo_size	= 16;
+
+	/* Transmit (main loop pushes, ISR pops) and Receive (ISR pushes, main loop pops) queues */
+	ring::spsc<uint8_t, uart::send_fifo_size> send_queue;
+	ring::spsc<uint8_t, uart::recv_fifo_size> recv_queue;
+
+	/*
+	 * Fills the hardware FIFO from the transmit queue, once it's empty.
+	 * Only called with the THRE interrupt disabled, or from the THRE interrupt itself, so
+	 * the queue has a single consumer.
+	 */
+	void transmit()
+	{
+		uint8_t byte;
 
-	/* Transmit and Receive buffers associated with the ring buffers */
-	uint16_t tx_buffer[send_fifo_size];
-	uint16_t rx_buffer[recv_fifo_size];
+		if (!(Chip_UART_ReadLineStatus(LPC_USART) & UART_LSR_THRE)) return;
 
-	/* Maximum size of UART messages */
-	const int msg_length		= 64;
+		for (int i=0; i<hardware_fifo_size && send_queue.pop(byte); ++i)
+		{
+			Chip_UART_SendByte(LPC_USART, byte);
+		}
+	}
+}
+
+namespace uart
+{
+	uint16_t recv_dropped = 0;
 
 	void init()
 	{
@@ -29,9 +48,11 @@ namespace uart
 		Chip_IOCON_PinMuxSet(LPC_IOCON, IOCON_PIO1_6, IOCON_FUNC1 | IOCON_MODE_INACT);	//RXD
 		Chip_IOCON_PinMuxSet(LPC_IOCON, IOCON_PIO1_7, IOCON_FUNC1 | IOCON_MODE_INACT);	//TXD
 
-		/* Init ring buffers */
-		RingBuffer_Init(&send_buffer, tx_buffer, msg_length, send_fifo_size);
-		RingBuffer_Init(&recv_buffer, rx_buffer, msg_length, recv_fifo_size);
+		/* Empties the queues (THRE interrupt off until something is sent) */
+		Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+		send_queue.clear();
+		recv_queue.clear();
+		recv_dropped = 0;
 
 		/* Sets Baud rate to default: 115200 */
 		Chip_UART_SetBaud(LPC_USART, 115200);
@@ -62,7 +83,10 @@ namespace uart
 		 * Enables two specific interrupts
 		 *
 		 * UART_IER_RBRINT			RBR Interrupt enabled	(RBR = Receiver Buffer Register , contains the next character received to be read)
-		 * UART_IER_THREINT			THR Interrupt enabled	(THR = Transmit Holding Register , contains the next character to be written)
+		 * UART_IER_RLSINT			RX Line Status Interrupt enabled (receive errors)
+		 *
+		 * UART_IER_THREINT (THR = Transmit Holding Register empty) is only enabled by send()
+		 * while the transmit queue isn't empty
 		 */
 		Chip_UART_IntEnable(LPC_USART, (UART_IER_RBRINT | UART_IER_RLSINT));
 
@@ -70,36 +94,49 @@ namespace uart
 		NVIC_EnableIRQ(UART0_IRQn);
 	}
 
-	void send(uint16_t *tx_data, int length)
+	bool send(const uint8_t *tx_data, int length)
 	{
 		/* Enables UART transmission */
 		gpio::set(pin::UART_EN);
 
-		/* If try to send more than maximum, do nothing */
-		if (length > msg_length) return;
+		/* If the message doesn't fit, do nothing */
+		if (length < 0 || !send_queue.write(tx_data, unsigned(length))) return false;
 
-		/* Populates the send_buffer and then sends it via UART */
-		Chip_UART_SendRB(LPC_USART, &send_buffer, tx_data, length);
+		/* Starts the transmission if the hardware FIFO is idle, the interrupt does the rest */
+		Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+		transmit();
+		if (!send_queue.empty()) Chip_UART_IntEnable(LPC_USART, UART_IER_THREINT);
+
+		return true;
 	}
 
-	void receive()
+	int receive(uint8_t *rx_data, int length)
 	{
+		int count = 0;
+
 		/* Enables UART receiving */
 		gpio::set(pin::UART_EN);
 
-		Chip_UART_ReadRB(LPC_USART, &recv_buffer, rx_buffer, recv_fifo_size);
+		while (count < length && recv_queue.pop(rx_data[count])) count++;
+
+		return count;
 	}
 }
 
 extern "C" __attribute__((interrupt)) void UART_IRQHandler ( void )
 {
-	/* Some error handling here?? */
+	/* Reading the line status also clears the line status (error) interrupt */
+	while (Chip_UART_ReadLineStatus(LPC_USART) & UART_LSR_RDR)
+	{
+		uint8_t byte = Chip_UART_ReadByte(LPC_USART);
 
-	/* Uses the default IRQ Handler for ring buffers */
-	/*
-	 * It will be called upon any send() or receive() call, and first it will send anything
-	 * inside the send_buffer, then it will handle receiving any message present in recv_buffer
-	 */
-	Chip_UART_IRQRBHandler(LPC_USART, &uart::recv_buffer, &uart::send_buffer);
-}
+		if (!recv_queue.push(byte) && uart::recv_dropped < UINT16_MAX) uart::recv_dropped++;
+	}
 
+	/* Transmission in progress: refills the hardware FIFO, stops when everything is out */
+	if (LPC_USART->IER & UART_IER_THREINT)
+	{
+		transmit();
+		if (send_queue.empty()) Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+	}
+}
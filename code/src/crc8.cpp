@@ -0,0 +1,74 @@
+/*
+ * crc8.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+#include "crc8.hpp"
+#include "BQ76930.hpp"
+
+#include "SEGGER_RTT.h"
+
+static_assert(crc8::tables<CRC_KEY>::verify(), "CRC8 lookup tables don't match the bitwise algorithm");
+
+/* Register space of the bq769x0 ends at ADCGAIN2 (0x59) */
+constexpr bool verify_afe_frames()
+{
+	for (int i=0; i<bms_config::n_afe; ++i)
+	{
+		if (!crc8::tables<CRC_KEY>::verify_frames(bms_config::afe_address[i], 0x59)) return false;
+	}
+	return true;
+}
+
+static_assert(verify_afe_frames(), "CRC8 lookup tables don't match the bitwise algorithm on the AFE frames");
+
+#ifdef CRC8_BENCHMARK
+namespace
+{
+	/* Same size of a whole cell voltages block read */
+	const int benchmark_size = 2 * BQ76930::pack_layout::cell_registers;
+
+	/* Elapsed SysTick cycles since \start (SysTick counts down) */
+	inline uint32_t elapsed(uint32_t start)
+	{
+		return (start - SysTick->VAL) & SysTick_LOAD_RELOAD_Msk;
+	}
+}
+
+namespace crc8
+{
+	void benchmark()
+	{
+		uint8_t buffer[benchmark_size];
+		uint8_t reference;
+		uint8_t result;
+		uint32_t start;
+		uint32_t bitwise_cycles;
+		uint32_t table_cycles;
+
+		for (int i=0; i<benchmark_size; ++i)
+		{
+			buffer[i] = uint8_t(i * 37 + 11);
+		}
+
+		/* Free running SysTick at core clock, no interrupt */
+		SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+		SysTick->VAL = 0;
+		SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+
+		start = SysTick->VAL;
+		reference = bitwise(buffer, benchmark_size, CRC_KEY);
+		bitwise_cycles = elapsed(start);
+
+		start = SysTick->VAL;
+		result = compute<CRC_KEY>(buffer, benchmark_size);
+		table_cycles = elapsed(start);
+
+		SysTick->CTRL = 0;
+
+		RTTOUT("CRC8 %s\n", reference == result ? "MATCH" : "MISMATCH");
+		RTTOUT("CRC8 bitwise\t%d cycles/byte\n", bitwise_cycles / benchmark_size);
+		RTTOUT("CRC8 table\t%d cycles/byte\n", table_cycles / benchmark_size);
+	}
+}
+#endif
@@ -15,12 +15,18 @@
 #include "bms_uart.hpp"
 #include "pins.hpp"
 #include "BQ76930.hpp"
+#include "bms_pack.hpp"
+#include "bms_events.hpp"
+#include "bms_scheduler.hpp"
+#include "bms_charge.hpp"
+#include "bms_trace.hpp"
+#include "telemetry.hpp"
 
 #include "SEGGER_RTT.h"
 
 /********GLOBAL VARIABLES********************/
-/* AFE global object used by the program */
-BQ76930 monitor;
+/* AFEs of the pack, global object used by the program */
+BMS_pack monitor;
 /* Current state of the BMS */
 state_t bms_state 				= SETUP;
 /* Sanity check used when closing DSG mosfet*/
@@ -28,284 +34,462 @@ bool check 						= true;
 /* Doesn't mess up with the sense_pos logic to enter
  * deep-sleep mode */
 bool lvb_sense 					= false;
-/* Sort of clock used to enable deep sleep mode */
-uint32_t deep_sleep_timer 		= 0;
+/* Time (ms) the LVB has been found disconnected at, used to enable deep sleep mode */
+uint32_t disconnected_at 		= 0;
 /* Enables charging procedure to remain set until setpoint is reached */
 bool in_charge 					= false;
-/* Counter that enables when sending CAN data (avoids bus overflowing) */
-int can_update_counter 			= 0;
-/* Counter that helps debouncing balancing enable and wakeup using the same button */
-int balancing_enabling_count 	= 0;
-/* Counter that calls balancing update according to the timeout */
-int balancing_enabler			= 0;
-/* Counter that enables de-bouncing of the charging procedure */
-int charging_enabling_count		= 0;
-/* Counter that enables resetting the state of the BMS */
-int status_reset				= 0;
+/* Time (ms) of the last wakeup or balancing enabling, debounces the shared button */
+uint32_t button_pressed_at 		= 0;
+/* Time (ms) of the last status encoding, enables resetting the state of the BMS */
+uint32_t status_reset_at		= 0;
+/* Deep sleep due, entered from the main loop once the tasks are done */
+bool sleep_requested			= false;
+/* Last state reported to the trace and to the ECU (state changes happen in interrupts too) */
+state_t traced_state			= SETUP;
+/* Sequence counter of the CAN telemetry cycles (4 bits) */
+uint8_t telemetry_sequence		= 0;
+/* AFE status read out when serving the ALERT pin */
+uint8_t afe_status				= 0;
+/* Cell voltages read queued, waiting for the I2C transactions to complete */
+bool cells_pending				= false;
+/* Initial state of charge estimate (0.1%) */
+int16_t initial_soc				= 0;
 /********************************************/
 
-/* BMS entry point. Should never return */
-int main(void)
+namespace
 {
-	SystemCoreClockUpdate();
-
-	/* Initializes all peripherals and the AFE driver */
-	pin::initialize_peripheral_pins();
-	adc::init_adc();
-	can::init_can();
-	uart::init();
-	timing::init();
-	monitor.init();
-
-	/* Initial state is checked twice at the beginning to get rid
-	 * of transient errors such as OVRD_ALERT.
-	 * If it's transient, second reading should give "OK" */
-	state::status_encoder();
-	state::status_encoder();
-
-    while(1)
-    {
-		/*
-		 * CHARGE state is entered when Delta is connected to the PCB and only when no error is present.
-		 * It stays in such state until reaching the LVB target voltage setpoint.
-		 * It's worth requiring that charging procedure doesn't start when the battery voltage is above a
-		 * pre-determined setpoint, in order to avoid problems.
-		 *
-		 * During the charging procedure, RTTOUTs are required in order to oversee the correct functioning
-		 */
-		if ((monitor.battery_voltage <= bms_config::voltage_setpoint) && (adc::current_sense <= bms_config::charge_enable_threshold) && (bms_state == READY))
+	/*
+	 * Status check, performed upon every AFE acquisition, to tackle unexpected errors immediately.
+	 * FIX 27/06/2019
+	 * If there's an error, we don't want to reset it immediately but let it persist for
+	 * reset_time ms, to avoid weird behaviors of the car
+	 */
+	void check_status(void)
+	{
+		if (in_charge)
 		{
-			/* This allows for disconnecting the charger whenever charging has finished
-			 * and not re-enter charging right after. This applies whenever the setpoint is lower
-			 * than the maximum LVB voltage or when the current doesn't go below the required setpoint */
-			if (charging_enabling_count++ == bms_config::charging_debounce)
-			{
-				in_charge = true;
-				RTTOUT("Charging Initiated\n");
-			}
-
-			while (in_charge)
+			state::status_encoder(afe_status);
+		}
+		else if (bms_state == READY || scheduler::now() - status_reset_at >= bms_config::reset_time)
+		{
+			if (!bms_config::alert_acquisition || afe_status != 0 || monitor.error_bit)
 			{
-				/* Signals charging procedure */
-				gpio::set(pin::UT_ERROR);
-
-				if (!monitor.balancing_enabled)
-				{
-					state::set_state(CHARGE);
-				}
-
-				monitor.read_cellvoltages();
-				for (int i=0; i<bms_config::n_cells; i++)
-				{
-					RTTOUT("CELL VOLTAGE\t(%d): %d\n", i+1, monitor.voltage_readings[i]);
-				}
-				state::status_encoder();
-				RTTOUT("BMS_STATE\t0x%02X\n", bms_state);
-
-				adc::measure_current();
-				RTTOUT("CURRENT\t%d\n", adc::current_sense);
-
-				adc::measure_temperature();
-				for (int i=0; i<bms_config::n_temperature_sensors; i++)
-				{
-					RTTOUT("TEMPERATURES\t(%d) %d\n", i+1, adc::temperature_readings[i]);
-				}
-
-				monitor.read_battery_voltage();
-				RTTOUT("BATTERY VOLTAGE\t%d\n", monitor.battery_voltage);
-
-				/***************************************************/
-				if (gpio::get_state(pin::wakeup))
-				{
-					RTTOUT("Enable balancing when charging\n");
-					monitor.balancing_enabled = true;
-					state::set_state(CHARGE_AND_BAL);
-
-					/* Signals balancing procedure */
-					gpio::set(pin::UT_ERROR);
-					gpio::set(pin::UV_ERROR);
-				}
-				if (monitor.balancing_enabled && balancing_enabler == bms_config::balancing_timeout)
-				{
-					monitor.check_balancing(true);
-					balancing_enabler = 0;
-				}
-				if (monitor.balancing_enabled)
-				{
-					balancing_enabler++;
-				}
-				monitor.check_balancing(false);
-				/***************************************************/
-
-				if (adc::current_sense >= bms_config::charge_stop_threshold)
-				{
-					/* Exit from CHARGE state */
-					RTTOUT("Charging Finished\n");
-					gpio::clear(pin::UT_ERROR);
-					monitor.write_register(sys_ctrl2, monitor.FET_DISABLE);
-					state::set_state(READY);
-					in_charge = false;
-					charging_enabling_count = 0;
-					check = true;
-					break;
-				}
+				state::status_encoder(afe_status);
 			}
+			status_reset_at = scheduler::now();
 		}
-
-		/* First execution of the code will enable DSG MOSFET */
-		if (check)
+		else if (afe_status & monitor.CC_READY)
 		{
-			monitor.write_register(sys_ctrl2, monitor.FET_ON);
-			check = false;
+			/* Error persisting: only acknowledge the new readings */
+			monitor.clear_status(monitor.CC_READY);
 		}
-
-		/* User-enabled balancing initialization (only when no errors occurred) */
-		if (gpio::get_state(pin::wakeup) && bms_state == READY && balancing_enabling_count > bms_config::balancing_debounce)
+	}
+
+	/*
+	 * Starts reading LVB cells voltages, the I2C transaction completes in background (I2C_DONE)
+	 */
+	void start_cellvoltages(void)
+	{
+		if (cells_pending) return;
+
+		cells_pending = true;
+		monitor.start_cellvoltages();
+	}
+
+	/*
+	 * AFE acquisition: with ALERT acquisition, the AFE is accessed only when it signals something
+	 * (cells are read when CC_READY says they have been refreshed, every 250ms).
+	 * Otherwise it runs at every status period.
+	 */
+	void acquire_afe(void)
+	{
+		afe_status = 0;
+		if (!monitor.error_bit)
 		{
-			monitor.balancing_enabled = true;
-			state::set_state(BALANCING);
-			balancing_enabling_count = 0;
+			afe_status = monitor.read_status();
+		}
 
-			/* Signals balancing procedure */
-			gpio::set(pin::UT_ERROR);
-			gpio::set(pin::UV_ERROR);
+		if (bms_config::alert_acquisition && (afe_status & monitor.CC_READY))
+		{
+			start_cellvoltages();
 		}
 
-		/* Balancing procedure */
-		if (monitor.balancing_enabled && balancing_enabler == bms_config::balancing_timeout)
+		/* Integrates LVB state of charge (new coulomb counter reading every 250ms) */
+		if (afe_status & monitor.CC_READY)
 		{
-			monitor.check_balancing(true);
-			balancing_enabler = 0;
+			monitor.read_stateofcharge();
 		}
 
-		/* Reads LVB cells voltages */
+		check_status();
+	}
+
+	/*
+	 * Completes the cell voltages read started by start_cellvoltages(), once the bus is done
+	 * with it. New readings are also checked against the balancing stop condition.
+	 */
+	void complete_cellvoltages(void)
+	{
+		if (!cells_pending || !monitor.cellvoltages_done()) return;
+
+		cells_pending = false;
+
+		/* Reads LVB cells voltages (no wait, the block read has completed) */
 		monitor.read_cellvoltages();
-		for (int i=0; i<bms_config::n_cells; i++)
+		for (int i=0; i<bms_config::pack_cells; i++)
 		{
-			RTTOUT("CELL VOLTAGE\t(%d): %d\n", i+1, monitor.voltage_readings[i]);
+			trace::log<trace::CELL_VOLTAGE>(i+1, monitor.voltage_readings[i]);
 		}
 
-		/* Reads LVB pack voltage */
-		monitor.read_battery_voltage();
-		RTTOUT("BATTERY VOLTAGE\t%d\n", monitor.battery_voltage);
+		/* Automatic balancing stop condition */
+		monitor.check_balancing(false);
+	}
 
-		/* Reads LVB state of charge */
-		monitor.read_stateofcharge();
+	/*
+	 * Scheduler tasks (see the task table below)
+	 */
 
-		/* Reads current flowing to/from the car/charger */
+	/*
+	 * Current: reads the current flowing to/from the car/charger, one ADC window per period
+	 */
+	void task_current(void)
+	{
 		adc::measure_current();
-		RTTOUT("Current\t%d\n", adc::current_sense);
-
-		/* Reads LVB cells temperatures */
+		trace::log<trace::CURRENT>(adc::current_sense);
+	}
+
+	/*
+	 * Status: AFE acquisition while the ALERT is still held by the AFE (fault not cleared
+	 * yet), or with no ALERT acquisition at all. While charging, the AFE is always read out.
+	 */
+	void task_status(void)
+	{
+		if (!bms_config::alert_acquisition || in_charge || monitor.alert_pending())
+		{
+			acquire_afe();
+		}
+	}
+
+	/*
+	 * Cell voltages: with ALERT acquisition the reads are started by CC_READY (unless
+	 * charging), here they are completed in case the I2C_DONE event has been merged
+	 * with an earlier one
+	 */
+	void task_cells(void)
+	{
+		if (!bms_config::alert_acquisition || in_charge)
+		{
+			start_cellvoltages();
+		}
+		complete_cellvoltages();
+	}
+
+	/*
+	 * Pack voltage: reads LVB pack voltage
+	 */
+	void task_pack_voltage(void)
+	{
+		monitor.read_battery_voltage();
+		trace::log<trace::BATTERY_VOLTAGE>(monitor.battery_voltage);
+	}
+
+	/*
+	 * Temperature: reads LVB cells temperatures
+	 */
+	void task_temperature(void)
+	{
 		adc::measure_temperature();
 		for (int i=0; i<bms_config::n_temperature_sensors; i++)
 		{
-			RTTOUT("TEMPERATURES\t(%d) %d\n", i+1, adc::temperature_readings[i]);
+			trace::log<trace::TEMPERATURE>(i+1, adc::temperature_readings[i]);
 		}
-
-		/* Status check is performed during each loop, to tackle unexpected errors immediately */
-		/* FIX 27/06/2019
-		 * If there's an error, we don't want to reset it immediately but let it persist for
-		 * 10s, to avoid weird behaviors of the car */
-		if (bms_state == READY || status_reset % bms_config::reset_count == 0)
+		if (adc::thermal_runaway)
 		{
-			state::status_encoder();
-			status_reset = 0;
+			trace::log<trace::THERMAL_RUNAWAY>(adc::thermal_runaway);
 		}
+	}
+
+	/*
+	 * STATUS telemetry frame, also sent on its own as soon as the state changes
+	 */
+	void send_status(can::priority level)
+	{
+		can::message message;
+		telemetry::status status;
+
+		status.state = bms_state;
+		status.pack_voltage = monitor.battery_voltage;
+		status.current = adc::current_sense;
+		status.state_of_charge = monitor.state_of_charge;
+		status.charge_phase = charge::phase;
+		status.balancing = monitor.balancing_enabled;
+		status.thermal_runaway = adc::thermal_runaway;
+
+		message.id = telemetry::STATUS_ID;
+		message.length = telemetry::FRAME_SIZE;
+		telemetry::encode_status(message.data, telemetry_sequence, status);
+		can::send(&message, level);
+	}
+
+	/*
+	 * CAN TX: sends the whole pack to the ECU as bit-packed telemetry (see telemetry.hpp),
+	 * the frames of a cycle share the sequence counter
+	 */
+	void task_can(void)
+	{
+		can::message message;
+
+		message.length = telemetry::FRAME_SIZE;
+
+		message.id = telemetry::CELLS_ID;
+		for (int group=0; group<telemetry::cell_frames(bms_config::pack_cells); ++group)
+		{
+			telemetry::encode_cells(message.data, telemetry_sequence, group, monitor.voltage_readings, bms_config::pack_cells);
+			can::send(&message);
+		}
+
+		send_status(can::PRIORITY_TELEMETRY);
 
-		if (can_update_counter++ == bms_config::can_update_limit)
+		message.id = telemetry::TEMPERATURES_ID;
+		for (int group=0; group<telemetry::temperature_frames(bms_config::n_temperature_sensors); ++group)
 		{
-			/* Prepares and send data over the CAN bus for the relevant variables */
-			protocol::bms::BMSVoltages voltage_data;
-			uint16_t subset[2] = { 0 };
-			for (uint8_t i = 0; i < bms_config::n_cells; i++)
-			{
-				if (i % 2 == 0)
-				{
-					voltage_data.cell = i;
-					if (i != 6)
-					{
-						subset[0] = monitor.voltage_readings[i];
-						subset[1] = monitor.voltage_readings[i+1];
-					}
-					else
-					{
-						subset[0] = monitor.voltage_readings[i];
-						subset[1] = 0;
-					}
-
-					for (int j=0; j<2; j++) voltage_data.voltages[j] = subset[j];
-					/* Do not use. DUT19's proprietary communication protocol */
-					// communication::send_data(&voltage_data);
-				}
-			}
-			/* Do not use. DUT19's proprietary communication protocol */
-			// protocol::bms::BMSBatVoltage batvoltage_data(monitor.battery_voltage);
-			// communication::send_data(&batvoltage_data);
-			// protocol::bms::BMSCharge charge_data(monitor.state_of_charge);
-			// communication::send_data(&charge_data);
-			// protocol::bms::BMSCurrent current_data(adc::current_sense);
-			// communication::send_data(&current_data);
-			// protocol::bms::BMSTemperatures temperature_data(adc::temperature_readings);
-			// communication::send_data(&temperature_data);
-			// protocol::bms::BMSState state_data(bms_state);
-			// communication::send_data(&state_data);
-
-			can_update_counter = 0;
+			telemetry::encode_temperatures(message.data, telemetry_sequence, group, adc::temperature_readings, bms_config::n_temperature_sensors);
+			can::send(&message);
 		}
 
-		/* Checks whether the LVB is being disconnected and starts the timer to enable
-		 * the transition to deep sleep mode. It also enables lvb_sense in order to check
-		 * for further connections of the LVB */
-		if (!gpio::get_state(pin::sense_pos) || !gpio::get_state(pin::sense_neg))
+		message.id = telemetry::CHARGE_ID;
+		telemetry::encode_charge(message.data, telemetry_sequence, charge::phase, charge::current_limit, charge::limit_pauses);
+		can::send(&message);
+
+		telemetry_sequence = (telemetry_sequence + 1) & 0x0F;
+	}
+
+	static_assert(bms_config::pack_cells <= telemetry::MAX_CELLS, "Too many cells for the telemetry");
+	static_assert(bms_config::n_temperature_sensors <= telemetry::MAX_SENSORS, "Too many sensors for the telemetry");
+	static_assert(bms_config::n_temperature_sensors <= telemetry::RUNAWAY_BITS, "Thermal runaway bits don't fit in the telemetry");
+
+	/*
+	 * Balancing: new balancing plan on the latest cell voltages
+	 */
+	void task_balancing(void)
+	{
+		if (monitor.balancing_enabled)
 		{
-			/* If balancing is enabled, BMS should not go to Deep Sleep until it
-			 * has finished doing so. */
-			if (!monitor.balancing_enabled)
-			{
-				/* Avoids weird behaviours of the "timer" */
-				if (!lvb_sense)
-				{
-					lvb_sense = true;
-				}
-				deep_sleep_timer++;
-
-				if (deep_sleep_timer == bms_config::deep_sleep_timeout)
-				{
-					state::enter_sleep_state();
-				}
-			}
+			monitor.check_balancing(true);
 		}
-		if ((gpio::get_state(pin::sense_pos) || gpio::get_state(pin::sense_neg)) && lvb_sense)
+	}
+
+	/*
+	 * Registers: periodic readback of the AFE configuration (catches AFE resets)
+	 */
+	void task_registers(void)
+	{
+		monitor.check_registers();
+	}
+
+	/*
+	 * Charge: steps the charge controller (see bms_charge.hpp)
+	 */
+	void task_charge(void)
+	{
+		charge::step();
+	}
+
+	/*
+	 * Supervisor: FETs, state changes (trace and CAN) and deep sleep
+	 */
+	void task_supervisor(void)
+	{
+		if (bms_state != traced_state)
 		{
-			/* Disables timer as LVB is connected again */
-			deep_sleep_timer = 0;
-			lvb_sense = false;
+			traced_state = bms_state;
+			trace::log<trace::BMS_STATE>(bms_state);
+			/* The ECU learns about faults right away, ahead of the periodic telemetry */
+			send_status(can::PRIORITY_FAULT);
 		}
 
-		/* Automatic balancing stop condition */
-		monitor.check_balancing(false);
-
-		/* Automatic increase of debouncer. The control over balancing_debounce * 2 is used
-		 * to prevent variable overflow or undesired behaviors */
-		if (balancing_enabling_count++ == bms_config::balancing_debounce * 2)
+		if (!in_charge && check)
 		{
-			balancing_enabling_count = 0;
+			/* First execution of the code will enable DSG MOSFET */
+			monitor.write_register(sys_ctrl2, monitor.FET_ON);
+			check = false;
 		}
 
-		if (monitor.balancing_enabled)
+		/* The LVB is disconnected: deep sleep after the timeout.
+		 * If balancing is enabled, BMS should not go to Deep Sleep until it
+		 * has finished doing so. */
+		if (lvb_sense && !monitor.balancing_enabled && scheduler::now() - disconnected_at >= bms_config::deep_sleep_timeout)
+		{
+			sleep_requested = true;
+		}
+	}
+
+	/*
+	 * Task table, in priority order: due tasks run in this order, and each one is delayed
+	 * at most by the budgets (us) of the ones before it. Phases (ms) keep the I2C tasks
+	 * sharing a period apart from each other.
+	 */
+	scheduler::task tasks[] =
+	{
+		{ task_current,			bms_config::current_period,			0,		300 },
+		{ task_status,			bms_config::status_period,			1,		3000 },
+		{ task_cells,			bms_config::cell_period,			3,		1000 },
+		{ task_pack_voltage,	bms_config::pack_voltage_period,	128,	1500 },
+		{ task_temperature,		bms_config::temperature_period,		5,		300 },
+		{ task_can,				bms_config::can_update_period,		7,		500 },
+		{ task_balancing,		bms_config::balancing_period,		11,		3000 },
+		{ task_registers,		bms_config::register_verify_period,	13,		4000 },
+		{ task_charge,			bms_config::charge_period,			9,		1000 },
+		{ task_supervisor,		bms_config::supervisor_period,		2,		1500 }
+	};
+
+	/* One ADC window is consumed per period */
+	static_assert(uint32_t(bms_config::current_period) * bms_config::current_sample_rate == uint32_t(bms_config::current_window) * 1000,
+			"Current task period differs from the current window");
+
+	/*
+	 * Wakeup button pressed: user-enabled balancing (only when no errors occurred)
+	 */
+	void on_button(void)
+	{
+		if (!gpio::get_state(pin::wakeup)) return;
+
+		if (in_charge)
+		{
+			trace::log<trace::BALANCING_CHARGE>();
+			monitor.balancing_enabled = true;
+			/* Also signals balancing procedure */
+			state::set_state(CHARGE_AND_BAL);
+		}
+		else if (bms_state == READY && scheduler::now() - button_pressed_at > bms_config::balancing_debounce)
+		{
+			monitor.balancing_enabled = true;
+			/* Also signals balancing procedure */
+			state::set_state(BALANCING);
+			button_pressed_at = scheduler::now();
+		}
+	}
+
+	/*
+	 * Checks whether the LVB is being disconnected and starts the timer to enable
+	 * the transition to deep sleep mode (checked by the supervisor task). Connecting
+	 * the LVB again stops the timer.
+	 */
+	void on_sense(void)
+	{
+		if (!gpio::get_state(pin::sense_pos) && !gpio::get_state(pin::sense_neg))
+		{
+			if (!lvb_sense) disconnected_at = scheduler::now();
+			lvb_sense = true;
+		}
+		else
 		{
-			balancing_enabler++;
+			/* Disables timer as LVB is connected again */
+			lvb_sense = false;
 		}
+	}
+
+	/*
+	 * BMS doesn't receive commands from the ECU: received frames are just dropped,
+	 * so the reception buffer never fills up
+	 */
+	void on_can_rx(void)
+	{
+		can::message message;
+
+		while (can::receive(&message)) {}
+	}
+}
 
-		/* When the BMS is in error state, the counter increases to avoid the error to be
-		 * wiped out with a subsequent usage of the status encoder function.
-		 * If car is in undervoltage error it's not safe to reset the error, so it will never be done. */
-		if (bms_state != READY || bms_state != UNDERVOLTAGE)
+/* BMS entry point. Should never return */
+int main(void)
+{
+	SystemCoreClockUpdate();
+
+	/* Initializes all peripherals and the AFE driver */
+	pin::initialize_peripheral_pins();
+	adc::init_adc();
+	can::init_can();
+	uart::init();
+	timing::init();
+	trace::init();
+	monitor.init();
+
+	/* Current zero offset, measured while the AFE keeps the FETs open (see BQ769x0::init) */
+	adc::calibrate_current();
+	RTTOUT("CURRENT OFFSET\t%d (%s)\n", adc::current_offset, adc::current_calibrated ? "calibrated" : "rejected");
+
+#ifdef CRC8_BENCHMARK
+	crc8::benchmark();
+#endif
+
+	/* Initial state is checked twice at the beginning to get rid
+	 * of transient errors such as OVRD_ALERT.
+	 * If it's transient, second reading should give "OK" */
+	state::status_encoder();
+	state::status_encoder();
+
+	/* State of charge integration starts from an estimate based on the average cell voltage */
+	monitor.read_cellvoltages();
+	initial_soc = int16_t((int32_t(monitor.avg_voltage) - bms_config::voltage_min) * 1000 / (bms_config::voltage_max - bms_config::voltage_min));
+	if (initial_soc < 0) initial_soc = 0;
+	if (initial_soc > 1000) initial_soc = 1000;
+	monitor.init_stateofcharge(bms_config::pack_capacity, initial_soc);
+
+	if (bms_config::alert_acquisition)
+	{
+		monitor.init_alert();
+	}
+
+	/* From now on everything is driven by the interrupts (see bms_events.hpp) and
+	 * by the scheduler (see bms_scheduler.hpp) */
+	scheduler::init(tasks, sizeof(tasks) / sizeof(tasks[0]));
+	events::init();
+
+	while(1)
+	{
+		/* The trace reaches the host while nothing else is waiting */
+		trace::flush();
+
+		switch (events::wait())
 		{
-			status_reset++;
+		case events::TICK:
+			scheduler::run();
+			if (sleep_requested)
+			{
+				sleep_requested = false;
+				trace::flush();
+				state::enter_sleep_state();
+			}
+			break;
+
+		case events::ALERT:
+			/* Faults are served right away, readings every 250ms (CC_READY) */
+			if (monitor.alert_pending())
+			{
+				acquire_afe();
+			}
+			break;
+
+		case events::BUTTON:
+			on_button();
+			break;
+
+		case events::SENSE:
+			on_sense();
+			break;
+
+		case events::I2C_DONE:
+			complete_cellvoltages();
+			break;
+
+		case events::CAN_RX:
+			on_can_rx();
+			break;
+
+		default:
+			break;
 		}
-    }
+	}
 
-    return 0;
+	return 0;
 }
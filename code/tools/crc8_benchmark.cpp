@@ -0,0 +1,108 @@
+/*
+ * crc8_benchmark.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * Host tool: benchmark of the bq76930 CRC8 (crc8.hpp), bitwise reference against the
+ * 256 bytes and the 16 bytes table variants, on the buffers the firmware checks:
+ * a register write frame (address, register, data), a register read frame (address,
+ * data) and a whole cell voltages block read (cells of a bq76930, 2 bytes each).
+ * Results are checked against the reference before timing. The on-target version is
+ * crc8::benchmark() (CRC8_BENCHMARK).
+ *
+ * Build and run with the host compiler:
+ * g++ -O2 -std=c++14 -I../inc crc8_benchmark.cpp -o crc8_benchmark && ./crc8_benchmark
+ */
+
+#include "crc8.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+	/* CRC_KEY of BQ76930.hpp (x8 + x2 + x + 1) */
+	constexpr uint8_t KEY = 7;
+	/* 7 bits I2C address of the AFE (bms_config::afe_address) */
+	constexpr uint8_t ADDRESS = 0x08;
+	/* VC1_HI..VC10_LO of the bq76930 */
+	constexpr int BLOCK_SIZE = 2 * 10;
+
+	constexpr long ROUNDS = 2000000;
+
+	typedef crc8::tables<KEY> tables;
+
+	/* Keeps the compiler from dropping the timed loops */
+	volatile uint8_t sink;
+
+	struct buffer
+	{
+		const char *name;
+		uint8_t data[BLOCK_SIZE];
+		uint8_t length;
+	};
+
+	template<typename CRC>
+	double nanoseconds_per_byte(const buffer &input, CRC crc)
+	{
+		uint8_t data[BLOCK_SIZE];
+		uint8_t result = 0;
+
+		for (int i=0; i<input.length; ++i) data[i] = input.data[i];
+
+		auto start = std::chrono::steady_clock::now();
+		for (long round=0; round<ROUNDS; ++round)
+		{
+			/* A different buffer every round, as the firmware sees */
+			data[input.length - 1] = uint8_t(round);
+			result ^= crc(data, input.length);
+		}
+		auto stop = std::chrono::steady_clock::now();
+
+		sink = result;
+		return std::chrono::duration<double, std::nano>(stop - start).count() / (double(ROUNDS) * input.length);
+	}
+
+	uint8_t bitwise(const uint8_t *data, uint8_t length)
+	{
+		return crc8::bitwise(data, length, KEY);
+	}
+}
+
+int main()
+{
+	buffer buffers[] =
+	{
+		{ "write frame", { uint8_t(ADDRESS << 1), 0x05, 0x03 }, 3 },
+		{ "read frame", { uint8_t((ADDRESS << 1) | 1), 0x80 }, 2 },
+		{ "cell block", {}, BLOCK_SIZE }
+	};
+	bool match = true;
+
+	for (int i=0; i<BLOCK_SIZE; ++i) buffers[2].data[i] = uint8_t(i * 37 + 11);
+
+	for (const buffer &input : buffers)
+	{
+		uint8_t reference = bitwise(input.data, input.length);
+
+		if (tables::byte_crc(input.data, input.length) != reference || tables::nibble_crc(input.data, input.length) != reference)
+		{
+			std::printf("%-12s MISMATCH\n", input.name);
+			match = false;
+		}
+	}
+	if (!match) return 1;
+
+	std::printf("%-12s %12s %12s %12s   (ns/byte)\n", "", "bitwise", "byte table", "nibble table");
+	for (const buffer &input : buffers)
+	{
+		std::printf("%-12s %12.2f %12.2f %12.2f\n", input.name,
+				nanoseconds_per_byte(input, bitwise),
+				nanoseconds_per_byte(input, tables::byte_crc),
+				nanoseconds_per_byte(input, tables::nibble_crc));
+	}
+
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * telemetry_decoder.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * Host tool: decoder of the BMS CAN telemetry (telemetry.hpp) from candump logs.
+ *
+ * Both the candump output formats are accepted, other CAN identifiers are skipped:
+ *   can0  301   [8]  12 34 56 78 9A BC DE F0
+ *   (1700000000.123456) can0 301#123456789ABCDEF0
+ *
+ * Every telemetry frame is printed on one line, prefixed by its sequence counter.
+ *
+ * Build and run with the host compiler:
+ * g++ -O2 -std=c++14 -I../inc telemetry_decoder.cpp -o telemetry_decoder
+ * candump can0 | ./telemetry_decoder		or		./telemetry_decoder candump.log
+ */
+
+#include "telemetry.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+namespace
+{
+	int hex_digit(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	/*
+	 * Identifier and payload of a candump line, FALSE if it isn't a frame
+	 */
+	bool parse(const char *line, unsigned &id, uint8_t *data, int &length)
+	{
+		const char *hash = std::strchr(line, '#');
+		char *end;
+
+		length = 0;
+
+		if (hash)
+		{
+			/* Log format: identifier right before '#', payload right after it */
+			const char *start = hash;
+
+			while (start > line && std::isxdigit(static_cast<unsigned char>(start[-1]))) start--;
+			id = unsigned(std::strtoul(start, nullptr, 16));
+
+			for (const char *p=hash+1; hex_digit(p[0]) >= 0 && hex_digit(p[1]) >= 0 && length < 8; p+=2)
+			{
+				data[length++] = uint8_t(hex_digit(p[0]) << 4 | hex_digit(p[1]));
+			}
+			return true;
+		}
+
+		/* Default format: interface, identifier, [length], bytes */
+		const char *bracket = std::strchr(line, '[');
+		const char *p;
+
+		if (!bracket) return false;
+
+		p = bracket;
+		while (p > line && std::isspace(static_cast<unsigned char>(p[-1]))) p--;
+		while (p > line && std::isxdigit(static_cast<unsigned char>(p[-1]))) p--;
+		id = unsigned(std::strtoul(p, nullptr, 16));
+
+		length = int(std::strtol(bracket + 1, &end, 10));
+		if (*end != ']' || length < 0 || length > 8) return false;
+
+		p = end + 1;
+		for (int i=0; i<length; ++i)
+		{
+			while (*p == ' ') p++;
+			if (hex_digit(p[0]) < 0 || hex_digit(p[1]) < 0) return false;
+			data[i] = uint8_t(hex_digit(p[0]) << 4 | hex_digit(p[1]));
+			p += 2;
+		}
+		return true;
+	}
+
+	void decode(unsigned id, const uint8_t *frame)
+	{
+		int group = telemetry::group(frame);
+
+		std::printf("%2u ", telemetry::sequence(frame));
+
+		switch (id)
+		{
+		case telemetry::CELLS_ID:
+			std::printf("CELLS");
+			for (int i=0; i<telemetry::CELLS_PER_FRAME; ++i)
+			{
+				uint16_t voltage = telemetry::cell(frame, i);
+
+				if (voltage) std::printf("  %d: %u mV", group * telemetry::CELLS_PER_FRAME + i + 1, voltage);
+			}
+			break;
+
+		case telemetry::STATUS_ID:
+		{
+			telemetry::status status = telemetry::decode_status(frame);
+
+			std::printf("STATUS  state 0x%02X  pack %u mV  current %d mA  SoC %d.%d%%  charge %u%s",
+					status.state, unsigned(status.pack_voltage), int(status.current),
+					status.state_of_charge / 10, status.state_of_charge % 10, status.charge_phase,
+					status.balancing ? "  balancing" : "");
+			if (status.thermal_runaway) std::printf("  THERMAL RUNAWAY 0x%02X", status.thermal_runaway);
+			break;
+		}
+
+		case telemetry::TEMPERATURES_ID:
+			std::printf("TEMPERATURES");
+			for (int i=0; i<telemetry::SENSORS_PER_FRAME; ++i)
+			{
+				int8_t temperature = telemetry::temperature(frame, i);
+
+				if (temperature != telemetry::NO_TEMPERATURE) std::printf("  %d: %d degC", group * telemetry::SENSORS_PER_FRAME + i + 1, temperature);
+			}
+			break;
+
+		case telemetry::CHARGE_ID:
+			std::printf("CHARGE  phase %u  limit %u mA  pauses %u", telemetry::charge_phase(frame),
+					telemetry::charge_limit(frame), telemetry::charge_pauses(frame));
+			break;
+
+		default:
+			break;
+		}
+
+		std::printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *input = argc > 1 ? std::fopen(argv[1], "r") : stdin;
+	char line[256];
+
+	if (!input)
+	{
+		std::fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	while (std::fgets(line, sizeof(line), input))
+	{
+		unsigned id;
+		uint8_t data[8] = {0};
+		int length;
+
+		if (!parse(line, id, data, length)) continue;
+		if (id < telemetry::CELLS_ID || id > telemetry::CHARGE_ID || length != telemetry::FRAME_SIZE) continue;
+
+		decode(id, data);
+	}
+
+	if (input != stdin) std::fclose(input);
+	return 0;
+}
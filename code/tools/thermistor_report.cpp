@@ -0,0 +1,127 @@
+/*
+ * thermistor_report.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * Host tool: accuracy report of the piecewise linear thermistor model (thermistor.hpp)
+ * against the 1024 entries lookup table previously used by the firmware (3 x °C, from
+ * the MATLAB script) and against the exact Beta model.
+ *
+ * Build and run with the host compiler:
+ * g++ -std=c++14 -I../inc thermistor_report.cpp -o thermistor_report && ./thermistor_report
+ */
+
+#include "thermistor.hpp"
+
+#include <cstdio>
+#include <cmath>
+
+namespace
+{
+	/* Old firmware lookup table (3 x °C for every ADC code) */
+	const int16_t lookup_table[thermistor::ADC_RANGE] = {
+	1800, 1425, 1131, 990, 903, 843, 795, 756, 723, 696, 675, 654, 636, 618, 603, 591, 576, 567, 555, 546, 537, 528, 519, 510,
+	504, 495, 489, 483, 477, 471, 465, 459, 456, 450, 444, 441, 435, 432, 426, 423, 420, 417, 411, 408, 405, 402, 399, 396,
+	393, 390, 387, 384, 381, 378, 375, 372, 369, 366, 363, 360, 360, 357, 354, 351, 351, 348, 345, 342, 342, 339, 336, 336,
+	333, 330, 330, 327, 327, 324, 321, 321, 318, 318, 315, 315, 312, 312, 309, 306, 306, 303, 303, 300, 300, 300, 297, 297,
+	294, 294, 291, 291, 288, 288, 285, 285, 285, 282, 282, 279, 279, 279, 276, 276, 273, 273, 273, 270, 270, 267, 267, 267,
+	264, 264, 264, 261, 261, 261, 258, 258, 258, 255, 255, 255, 252, 252, 252, 249, 249, 249, 246, 246, 246, 243, 243, 243,
+	243, 240, 240, 240, 237, 237, 237, 237, 234, 234, 234, 231, 231, 231, 231, 228, 228, 228, 228, 225, 225, 225, 225, 222,
+	222, 222, 222, 219, 219, 219, 219, 216, 216, 216, 216, 213, 213, 213, 213, 210, 210, 210, 210, 210, 207, 207, 207, 207,
+	204, 204, 204, 204, 204, 201, 201, 201, 201, 201, 198, 198, 198, 198, 198, 195, 195, 195, 195, 195, 192, 192, 192, 192,
+	192, 189, 189, 189, 189, 189, 186, 186, 186, 186, 186, 183, 183, 183, 183, 183, 183, 180, 180, 180, 180, 180, 177, 177,
+	177, 177, 177, 177, 174, 174, 174, 174, 174, 174, 171, 171, 171, 171, 171, 171, 168, 168, 168, 168, 168, 168, 165, 165,
+	165, 165, 165, 165, 162, 162, 162, 162, 162, 162, 162, 159, 159, 159, 159, 159, 159, 156, 156, 156, 156, 156, 156, 156,
+	153, 153, 153, 153, 153, 153, 153, 150, 150, 150, 150, 150, 150, 150, 147, 147, 147, 147, 147, 147, 147, 144, 144, 144,
+	144, 144, 144, 144, 141, 141, 141, 141, 141, 141, 141, 138, 138, 138, 138, 138, 138, 138, 138, 135, 135, 135, 135, 135,
+	135, 135, 135, 132, 132, 132, 132, 132, 132, 132, 129, 129, 129, 129, 129, 129, 129, 129, 126, 126, 126, 126, 126, 126,
+	126, 126, 123, 123, 123, 123, 123, 123, 123, 123, 123, 120, 120, 120, 120, 120, 120, 120, 120, 117, 117, 117, 117, 117,
+	117, 117, 117, 114, 114, 114, 114, 114, 114, 114, 114, 114, 111, 111, 111, 111, 111, 111, 111, 111, 111, 108, 108, 108,
+	108, 108, 108, 108, 108, 105, 105, 105, 105, 105, 105, 105, 105, 105, 102, 102, 102, 102, 102, 102, 102, 102, 102, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 96, 96, 96, 96, 96, 96, 96, 96, 96, 93, 93, 93, 93, 93, 93,
+	93, 93, 93, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 87, 87, 87, 87, 87, 87, 87, 87, 87, 84, 84,
+	84, 84, 84, 84, 84, 84, 84, 84, 81, 81, 81, 81, 81, 81, 81, 81, 81, 81, 78, 78, 78, 78, 78, 78,
+	78, 78, 78, 78, 75, 75, 75, 75, 75, 75, 75, 75, 75, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 69,
+	69, 69, 69, 69, 69, 69, 69, 69, 69, 66, 66, 66, 66, 66, 66, 66, 66, 66, 66, 63, 63, 63, 63, 63,
+	63, 63, 63, 63, 63, 63, 60, 60, 60, 60, 60, 60, 60, 60, 60, 60, 57, 57, 57, 57, 57, 57, 57, 57,
+	57, 57, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 51, 51, 51, 51, 51, 51, 51, 51, 51, 51, 48, 48,
+	48, 48, 48, 48, 48, 48, 48, 48, 45, 45, 45, 45, 45, 45, 45, 45, 45, 45, 45, 42, 42, 42, 42, 42,
+	42, 42, 42, 42, 42, 39, 39, 39, 39, 39, 39, 39, 39, 39, 39, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+	36, 33, 33, 33, 33, 33, 33, 33, 33, 33, 33, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 27, 27, 27,
+	27, 27, 27, 27, 27, 27, 27, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 21, 21, 21, 21, 21, 21, 21,
+	21, 21, 21, 18, 18, 18, 18, 18, 18, 18, 18, 18, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 12, 12,
+	12, 12, 12, 12, 12, 12, 12, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, -3, -3, -3, -3,
+	-3, -3, -3, -3, -3, -6, -6, -6, -6, -6, -6, -6, -6, -6, -9, -9, -9, -9, -9, -9, -9, -9, -9, -12,
+	-12, -12, -12, -12, -12, -12, -12, -15, -15, -15, -15, -15, -15, -15, -15, -18, -18, -18, -18, -18, -18, -18, -18, -21,
+	-21, -21, -21, -21, -21, -21, -21, -24, -24, -24, -24, -24, -24, -24, -24, -27, -27, -27, -27, -27, -27, -27, -27, -30,
+	-30, -30, -30, -30, -30, -30, -33, -33, -33, -33, -33, -33, -33, -36, -36, -36, -36, -36, -36, -36, -39, -39, -39, -39,
+	-39, -39, -39, -42, -42, -42, -42, -42, -42, -42, -45, -45, -45, -45, -45, -45, -45, -48, -48, -48, -48, -48, -48, -51,
+	-51, -51, -51, -51, -51, -54, -54, -54, -54, -54, -54, -57, -57, -57, -57, -57, -57, -60, -60, -60, -60, -60, -63, -63,
+	-63, -63, -63, -63, -66, -66, -66, -66, -66, -69, -69, -69, -69, -69, -72, -72, -72, -72, -72, -75, -75, -75, -75, -78,
+	-78, -78, -78, -78, -81, -81, -81, -81, -84, -84, -84, -84, -87, -87, -87, -87, -90, -90, -90, -90, -93, -93, -93, -93,
+	-96, -96, -96, -99, -99, -99, -102, -102, -102, -102, -105, -105, -105, -108, -108, -108, -111, -111, -114, -114, -114, -117, -117, -117,
+	-120, -120, -123, -123, -126, -126, -129, -129, -132, -132, -135, -135, -138, -138, -141, -141, -144, -147, -147, -150, -153, -153, -156, -159,
+	-162, -165, -168, -171, -174, -177, -180, -186, -189, -195, -201, -207, -216, -228, -240, -264
+	};
+
+	const double scale = 1 << thermistor::FRACTION_BITS;
+
+	struct error_stats
+	{
+		double max = 0;
+		double sum = 0;
+		int worst_adc = 0;
+		int count = 0;
+
+		void add(int adc, double error)
+		{
+			error = std::fabs(error);
+			sum += error;
+			count++;
+			if (error > max)
+			{
+				max = error;
+				worst_adc = adc;
+			}
+		}
+	};
+
+	void report(int min, int max)
+	{
+		error_stats against_table;
+		error_stats against_model;
+
+		for (int adc=0; adc<thermistor::ADC_RANGE; ++adc)
+		{
+			double exact = thermistor::model(adc);
+			double interpolated = thermistor::temperature(uint16_t(adc)) / scale;
+
+			if (exact < min || exact > max) continue;
+
+			against_table.add(adc, interpolated - lookup_table[adc] / 3.0);
+			against_model.add(adc, interpolated - exact);
+		}
+
+		std::printf("%4d..%4d degC  %4d codes  vs table: max %.3f (ADC %4d) mean %.3f  vs model: max %.3f (ADC %4d) mean %.3f\n",
+				min, max, against_model.count,
+				against_table.max, against_table.worst_adc, against_table.sum / against_table.count,
+				against_model.max, against_model.worst_adc, against_model.sum / against_model.count);
+	}
+}
+
+int main()
+{
+	std::printf("Thermistor model: BETA %.0f K, %d segments of %d codes, 1/%d degC resolution\n",
+			thermistor::BETA, thermistor::curve_type::segments, 1 << thermistor::SEGMENT_BITS, 1 << thermistor::FRACTION_BITS);
+	std::printf("Flash: %u bytes (lookup table: %u bytes)\n\n",
+			unsigned(sizeof(thermistor::curve_type)), unsigned(sizeof(lookup_table)));
+
+	report(-20, 80);
+	report(-40, 125);
+	report(-60, 200);
+
+	return 0;
+}
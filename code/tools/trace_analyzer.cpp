@@ -0,0 +1,740 @@
+/*
+ * trace_analyzer.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+/*
+ * Host tool: decoder and analyzer of the BMS output captures.
+ *
+ * Both the binary trace (RTT channel 1, see bms_trace.hpp) and the text output of the
+ * older firmwares (RTTOUT, RTT channel 0 or UART) are accepted: the text lines are matched
+ * against the same message formats of trace_messages.hpp, and against the legacy spellings
+ * of TRACE_TEXT_ALIASES. The format is detected from the content, and a binary capture may
+ * start anywhere in the stream.
+ *
+ * Synthetic samples of both paths (tools/samples):
+ * legacy_text_synthetic.txt	older firmware text output (7 cells, 3 sensors, normal and charging
+ *								loops): 77 records, every line recognized
+ * trace_midstream.bin			binary trace attached in the middle of a record: 2 bytes skipped,
+ *								215 records over 1999 ms
+ *
+ * The capture is memory mapped and parsed in place, the samples are collected per series
+ * and written as one CSV table per group in the output directory:
+ * cells.csv			time, cell_1 .. cell_N (mV), one row per cell voltages read
+ * temperatures.csv		time, sensor_1 .. sensor_M (°C), one row per temperatures read
+ * current.csv			time, current (mA)
+ * pack.csv				time, pack voltage (mV)
+ * state.csv			time, BMS state
+ * charge.csv			time, charge controller phase
+ * The time is in ms for the binary trace. Text captures have no time, the record number
+ * is used instead.
+ * A summary (samples, min, max, mean, standard deviation of every series, time in every
+ * state, dropped records) is printed on stdout.
+ *
+ * Build and run with the host compiler:
+ * g++ -O2 -std=c++14 -I../inc trace_analyzer.cpp -o trace_analyzer
+ * ./trace_analyzer [-f auto|binary|text] [-o directory] [-d] capture
+ * -d prints the decoded messages (binary trace to text) on stdout instead of the analysis.
+ */
+
+#include "trace_messages.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+	#define MESSAGE_ID(name, format, arguments)			name,
+	#define MESSAGE_INFO(name, format, arguments)		{ #name, format, arguments },
+
+	enum message_id : uint8_t
+	{
+		TRACE_MESSAGES(MESSAGE_ID)
+
+		N_MESSAGES
+	};
+
+	struct message_info
+	{
+		const char *name;
+		const char *format;
+		int arguments;
+	};
+
+	const message_info messages[] = { TRACE_MESSAGES(MESSAGE_INFO) };
+
+	#define ALIAS_INFO(name, format)		{ name, format },
+
+	struct alias_info
+	{
+		message_id id;
+		const char *format;
+	};
+
+	/* Legacy text spellings (see trace_messages.hpp) */
+	const alias_info aliases[] = { TRACE_TEXT_ALIASES(ALIAS_INFO) };
+
+	#undef MESSAGE_ID
+	#undef MESSAGE_INFO
+	#undef ALIAS_INFO
+
+	constexpr int MAX_ARGUMENTS = 8;
+
+	/*
+	 * Buffered output, one fwrite every 64KB
+	 */
+	class writer
+	{
+	private:
+		FILE *file = nullptr;
+		char buffer[1 << 16];
+		size_t used = 0;
+
+		void reserve(size_t n)
+		{
+			if (used + n > sizeof(buffer)) flush();
+		}
+
+	public:
+		bool open(const std::string &path)
+		{
+			file = std::fopen(path.c_str(), "w");
+			return file != nullptr;
+		}
+
+		void flush()
+		{
+			if (file && used) std::fwrite(buffer, 1, used, file);
+			used = 0;
+		}
+
+		void close()
+		{
+			flush();
+			if (file) std::fclose(file);
+			file = nullptr;
+		}
+
+		void text(const char *s)
+		{
+			size_t n = std::strlen(s);
+
+			reserve(n);
+			std::memcpy(buffer + used, s, n);
+			used += n;
+		}
+
+		void character(char c)
+		{
+			reserve(1);
+			buffer[used++] = c;
+		}
+
+		void number(int64_t value)
+		{
+			char digits[24];
+			int n = 0;
+			uint64_t magnitude = value < 0 ? uint64_t(-value) : uint64_t(value);
+
+			reserve(sizeof(digits));
+			if (value < 0) buffer[used++] = '-';
+			do
+			{
+				digits[n++] = char('0' + magnitude % 10);
+				magnitude /= 10;
+			}
+			while (magnitude);
+			while (n) buffer[used++] = digits[--n];
+		}
+	};
+
+	struct statistics
+	{
+		uint64_t count = 0;
+		int64_t min = INT64_MAX;
+		int64_t max = INT64_MIN;
+		double sum = 0;
+		double sum_squares = 0;
+
+		void add(int32_t value)
+		{
+			count++;
+			if (value < min) min = value;
+			if (value > max) max = value;
+			sum += value;
+			sum_squares += double(value) * value;
+		}
+
+		void print(const char *name) const
+		{
+			double mean;
+
+			if (!count) return;
+			mean = sum / count;
+			std::printf("%-20s %10llu  min %8lld  max %8lld  mean %10.2f  std %9.2f\n", name,
+					(unsigned long long)count, (long long)min, (long long)max, mean,
+					std::sqrt(std::fmax(sum_squares / count - mean * mean, 0.0)));
+		}
+	};
+
+	/*
+	 * Samples of one series, as columns
+	 */
+	struct series
+	{
+		std::vector<uint64_t> time;
+		std::vector<int32_t> value;
+		statistics stats;
+
+		void add(uint64_t t, int32_t v)
+		{
+			time.push_back(t);
+			value.push_back(v);
+			stats.add(v);
+		}
+	};
+
+	class analyzer
+	{
+	private:
+		/* Indexed series (cells, sensors), index 1 first as in the firmware output */
+		std::vector<series> cells;
+		std::vector<series> temperatures;
+		series current;
+		series pack;
+		series state;
+		series charge;
+
+		uint64_t records = 0;
+		uint64_t dropped = 0;
+		uint64_t last_time = 0;
+
+		static void add_indexed(std::vector<series> &group, uint64_t time, int32_t index, int32_t value)
+		{
+			/* Indices come from the capture: anything unreasonable is corrupted data */
+			if (index < 1 || index > 64) return;
+			if (group.size() < size_t(index)) group.resize(size_t(index));
+			group[size_t(index - 1)].add(time, value);
+		}
+
+		/*
+		 * One row per read of the group: the k-th sample of every member belongs to row k
+		 * (the firmware reads the whole group at once), timed by its first sample
+		 */
+		static bool write_group(const std::string &path, const char *column, const std::vector<series> &group)
+		{
+			writer out;
+			size_t rows = 0;
+
+			if (group.empty()) return true;
+			if (!out.open(path)) return false;
+
+			out.text("time");
+			for (size_t i=0; i<group.size(); ++i)
+			{
+				out.character(',');
+				out.text(column);
+				out.number(int64_t(i + 1));
+				if (group[i].value.size() > rows) rows = group[i].value.size();
+			}
+			out.character('\n');
+
+			for (size_t row=0; row<rows; ++row)
+			{
+				for (size_t i=0; i<group.size(); ++i)
+				{
+					if (row < group[i].time.size())
+					{
+						out.number(int64_t(group[i].time[row]));
+						break;
+					}
+				}
+				for (size_t i=0; i<group.size(); ++i)
+				{
+					out.character(',');
+					if (row < group[i].value.size()) out.number(group[i].value[row]);
+				}
+				out.character('\n');
+			}
+
+			out.close();
+			return true;
+		}
+
+		static bool write_series(const std::string &path, const char *column, const series &samples)
+		{
+			writer out;
+
+			if (samples.value.empty()) return true;
+			if (!out.open(path)) return false;
+
+			out.text("time,");
+			out.text(column);
+			out.character('\n');
+			for (size_t i=0; i<samples.value.size(); ++i)
+			{
+				out.number(int64_t(samples.time[i]));
+				out.character(',');
+				out.number(samples.value[i]);
+				out.character('\n');
+			}
+
+			out.close();
+			return true;
+		}
+
+	public:
+		void add(message_id id, uint64_t time, const int32_t *arguments)
+		{
+			records++;
+			last_time = time;
+
+			switch (id)
+			{
+			case TRACE_START:
+				if (arguments[0] != TRACE_VERSION)
+				{
+					std::fprintf(stderr, "Trace version %d, decoder version %d\n", arguments[0], TRACE_VERSION);
+				}
+				break;
+			case TRACE_DROPPED:		dropped += uint32_t(arguments[0]);							break;
+			case CELL_VOLTAGE:		add_indexed(cells, time, arguments[0], arguments[1]);			break;
+			case TEMPERATURE:		add_indexed(temperatures, time, arguments[0], arguments[1]);	break;
+			case CURRENT:			current.add(time, arguments[0]);							break;
+			case BATTERY_VOLTAGE:	pack.add(time, arguments[0]);								break;
+			case BMS_STATE:			state.add(time, arguments[0]);								break;
+			case CHARGE_PHASE:		charge.add(time, arguments[0]);								break;
+			default:																			break;
+			}
+		}
+
+		bool write(const std::string &directory)
+		{
+			return write_group(directory + "/cells.csv", "cell_", cells) &&
+					write_group(directory + "/temperatures.csv", "sensor_", temperatures) &&
+					write_series(directory + "/current.csv", "current", current) &&
+					write_series(directory + "/pack.csv", "pack", pack) &&
+					write_series(directory + "/state.csv", "state", state) &&
+					write_series(directory + "/charge.csv", "phase", charge);
+		}
+
+		void summary(bool timed) const
+		{
+			char name[48];
+			std::map<int32_t, uint64_t> time_in_state;
+
+			std::printf("Records %llu, dropped %llu, %s %llu\n\n", (unsigned long long)records,
+					(unsigned long long)dropped, timed ? "duration (ms)" : "last record", (unsigned long long)last_time);
+
+			for (size_t i=0; i<cells.size(); ++i)
+			{
+				std::snprintf(name, sizeof(name), "cell %zu (mV)", i + 1);
+				cells[i].stats.print(name);
+			}
+			for (size_t i=0; i<temperatures.size(); ++i)
+			{
+				std::snprintf(name, sizeof(name), "sensor %zu (degC)", i + 1);
+				temperatures[i].stats.print(name);
+			}
+			current.stats.print("current (mA)");
+			pack.stats.print("pack (mV)");
+
+			/* Every state lasts until the next state record (or the end of the capture) */
+			for (size_t i=0; i<state.value.size(); ++i)
+			{
+				uint64_t end = i + 1 < state.time.size() ? state.time[i + 1] : last_time;
+				time_in_state[state.value[i]] += end - state.time[i];
+			}
+			if (!time_in_state.empty()) std::printf("\n");
+			for (const auto &entry : time_in_state)
+			{
+				std::printf("state 0x%02X %s %llu\n", unsigned(entry.first), timed ? "time (ms)" : "records",
+						(unsigned long long)entry.second);
+			}
+		}
+	};
+
+	/*
+	 * Decoded message in text, with the firmware format
+	 */
+	void print_message(message_id id, uint64_t time, const int32_t *arguments, bool timed)
+	{
+		if (timed) std::printf("%10llu  ", (unsigned long long)time);
+		std::printf(messages[id].format, arguments[0], arguments[1], arguments[2], arguments[3]);
+	}
+
+	/*
+	 * Binary trace: ID, delta time (LEB128), zigzag arguments (see trace_messages.hpp)
+	 *
+	 * A capture doesn't have to start with TRACE_START (RTT attached after the boot): the
+	 * parser starts at the first position where sync_records records in a row decode, and
+	 * syncs again the same way after a corrupted record.
+	 */
+	class binary_parser
+	{
+	private:
+		static constexpr int sync_records = 4;
+
+		const uint8_t *data;
+		const uint8_t *end;
+
+		/* Unsigned LEB128, at most 32 bits */
+		bool varint(const uint8_t *&at, uint32_t &value) const
+		{
+			value = 0;
+			for (int shift=0; shift<35 && at < end; shift+=7)
+			{
+				uint8_t byte = *at++;
+
+				if (shift == 28 && byte > 0x0F) return false;
+				value |= uint32_t(byte & 0x7F) << shift;
+				if (!(byte & 0x80)) return true;
+			}
+			return false;
+		}
+
+		/* Decodes the record at \at, FALSE if it isn't a valid one */
+		bool record(const uint8_t *&at, message_id &id, uint32_t &delta, int32_t *arguments) const
+		{
+			if (at >= end || *at >= N_MESSAGES) return false;
+
+			id = message_id(*at++);
+			if (!varint(at, delta)) return false;
+
+			for (int i=0; i<messages[id].arguments; ++i)
+			{
+				uint32_t value;
+
+				if (!varint(at, value)) return false;
+				arguments[i] = int32_t(value >> 1) ^ -int32_t(value & 1);
+			}
+
+			return true;
+		}
+
+		/* TRUE if sync_records records (or all of them up to the end) decode from \at */
+		bool in_sync(const uint8_t *at) const
+		{
+			int32_t arguments[MAX_ARGUMENTS];
+			message_id id;
+			uint32_t delta;
+
+			for (int n=0; n<sync_records && at < end; ++n)
+			{
+				if (!record(at, id, delta, arguments)) return false;
+			}
+
+			return true;
+		}
+
+		/* Skips to the next position in sync */
+		void sync()
+		{
+			const uint8_t *start = data;
+
+			while (data < end && !in_sync(data)) data++;
+			skipped += uint64_t(data - start);
+		}
+
+	public:
+		uint64_t skipped = 0;
+
+		binary_parser(const uint8_t *begin, size_t size) : data(begin), end(begin + size) {}
+
+		template<typename SINK>
+		void run(SINK sink)
+		{
+			uint64_t time = 0;
+			int32_t arguments[MAX_ARGUMENTS] = {0};
+
+			sync();
+
+			while (data < end)
+			{
+				const uint8_t *next = data;
+				message_id id;
+				uint32_t delta;
+
+				if (!record(next, id, delta, arguments))
+				{
+					data++;
+					skipped++;
+					sync();
+					continue;
+				}
+				data = next;
+
+				if (id == TRACE_START) time = 0;
+				time += delta;
+				sink(id, time, arguments);
+			}
+		}
+	};
+
+	/*
+	 * Text output: every line is matched against the message formats
+	 */
+	class text_parser
+	{
+	private:
+		const char *data;
+		const char *end;
+
+		/* Integer conversion (flags and width are skipped, 'l' modifiers too) */
+		static bool convert(const char *&format, const char *&line, const char *line_end, int32_t &value)
+		{
+			int base = 10;
+			bool negative = false;
+			bool digits = false;
+			int64_t result = 0;
+
+			while (*format == '-' || *format == '+' || *format == ' ' || *format == '#' || *format == '0' ||
+					(*format >= '1' && *format <= '9') || *format == 'l')
+			{
+				format++;
+			}
+			if (*format == 'x' || *format == 'X') base = 16;
+			else if (*format != 'd' && *format != 'u' && *format != 'i') return false;
+			format++;
+
+			while (line < line_end && *line == ' ') line++;
+			if (line < line_end && *line == '-')
+			{
+				negative = true;
+				line++;
+			}
+			for (; line < line_end; ++line)
+			{
+				int digit;
+
+				if (*line >= '0' && *line <= '9') digit = *line - '0';
+				else if (base == 16 && *line >= 'a' && *line <= 'f') digit = *line - 'a' + 10;
+				else if (base == 16 && *line >= 'A' && *line <= 'F') digit = *line - 'A' + 10;
+				else break;
+
+				result = result * base + digit;
+				digits = true;
+			}
+
+			value = int32_t(negative ? -result : result);
+			return digits;
+		}
+
+		static bool match(const char *format, const char *line, const char *line_end, int32_t *arguments)
+		{
+			int n = 0;
+
+			while (*format && *format != '\n')
+			{
+				if (*format == '%' && format[1] != '%')
+				{
+					format++;
+					if (n == MAX_ARGUMENTS || !convert(format, line, line_end, arguments[n++])) return false;
+				}
+				else
+				{
+					if (*format == '%') format++;
+					if (line == line_end || *line != *format) return false;
+					line++;
+					format++;
+				}
+			}
+
+			/* Trailing carriage return of CRLF captures */
+			while (line < line_end && (*line == '\r' || *line == ' ')) line++;
+			return line == line_end;
+		}
+
+	public:
+		uint64_t unknown = 0;
+
+		text_parser(const char *begin, size_t size) : data(begin), end(begin + size) {}
+
+		template<typename SINK>
+		void run(SINK sink)
+		{
+			uint64_t record = 0;
+			int32_t arguments[MAX_ARGUMENTS] = {0};
+
+			while (data < end)
+			{
+				const char *line_end = static_cast<const char *>(std::memchr(data, '\n', size_t(end - data)));
+				bool found = false;
+
+				if (!line_end) line_end = end;
+
+				if (line_end != data)
+				{
+					for (int id=0; id<N_MESSAGES && !found; ++id)
+					{
+						/* Most of the formats are rejected by the first character */
+						if (*messages[id].format != *data) continue;
+						if (match(messages[id].format, data, line_end, arguments))
+						{
+							sink(message_id(id), record++, arguments);
+							found = true;
+						}
+					}
+					for (const alias_info &alias : aliases)
+					{
+						if (found) break;
+						if (*alias.format != *data) continue;
+						if (match(alias.format, data, line_end, arguments))
+						{
+							sink(alias.id, record++, arguments);
+							found = true;
+						}
+					}
+					if (!found) unknown++;
+				}
+
+				data = line_end + 1;
+			}
+		}
+	};
+
+	/*
+	 * Memory mapped capture (read all at once from a pipe)
+	 */
+	struct capture
+	{
+		const uint8_t *data = nullptr;
+		size_t size = 0;
+		std::vector<uint8_t> copy;
+		void *mapping = nullptr;
+
+		bool open(const char *path)
+		{
+			int fd = std::strcmp(path, "-") == 0 ? 0 : ::open(path, O_RDONLY);
+			struct stat info;
+
+			if (fd < 0) return false;
+
+			if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+			{
+				size = size_t(info.st_size);
+				if (size)
+				{
+					mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (mapping == MAP_FAILED) return false;
+					madvise(mapping, size, MADV_SEQUENTIAL);
+					data = static_cast<const uint8_t *>(mapping);
+				}
+			}
+			else
+			{
+				uint8_t chunk[1 << 16];
+				ssize_t n;
+
+				while ((n = read(fd, chunk, sizeof(chunk))) > 0) copy.insert(copy.end(), chunk, chunk + n);
+				data = copy.data();
+				size = copy.size();
+			}
+
+			if (fd != 0) close(fd);
+			return true;
+		}
+
+		/*
+		 * Text has no control characters but tab and line ends, while the IDs of the binary
+		 * trace are small numbers: one of them in the first 4KB tells them apart
+		 */
+		bool binary() const
+		{
+			size_t length = size < 4096 ? size : 4096;
+
+			for (size_t i=0; i<length; ++i)
+			{
+				if (data[i] < 0x20 && data[i] != '\t' && data[i] != '\n' && data[i] != '\r') return true;
+			}
+
+			return false;
+		}
+	};
+
+	void usage(const char *program)
+	{
+		std::fprintf(stderr, "Usage: %s [-f auto|binary|text] [-o directory] [-d] capture\n", program);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static analyzer analysis;
+	capture input;
+	std::string directory = ".";
+	const char *format = "auto";
+	const char *path = nullptr;
+	bool decode = false;
+	bool binary;
+
+	static_assert(sizeof(messages) / sizeof(messages[0]) == N_MESSAGES, "Message table mismatch");
+
+	for (int i=1; i<argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) format = argv[++i];
+		else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) directory = argv[++i];
+		else if (std::strcmp(argv[i], "-d") == 0) decode = true;
+		else if (!path) path = argv[i];
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (int id=0; id<N_MESSAGES; ++id)
+	{
+		if (messages[id].arguments > MAX_ARGUMENTS) return 1;
+	}
+
+	if (!path || !input.open(path))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	binary = std::strcmp(format, "binary") == 0 || (std::strcmp(format, "auto") == 0 && input.binary());
+
+	if (binary)
+	{
+		binary_parser parser(input.data, input.size);
+
+		if (decode) parser.run([](message_id id, uint64_t time, const int32_t *arguments) { print_message(id, time, arguments, true); });
+		else parser.run([](message_id id, uint64_t time, const int32_t *arguments) { analysis.add(id, time, arguments); });
+
+		if (parser.skipped) std::fprintf(stderr, "%llu bytes skipped (partial or corrupted records)\n", (unsigned long long)parser.skipped);
+	}
+	else
+	{
+		text_parser parser(reinterpret_cast<const char *>(input.data), input.size);
+
+		if (decode) parser.run([](message_id id, uint64_t time, const int32_t *arguments) { print_message(id, time, arguments, false); });
+		else parser.run([](message_id id, uint64_t time, const int32_t *arguments) { analysis.add(id, time, arguments); });
+
+		if (parser.unknown) std::fprintf(stderr, "%llu lines not recognized\n", (unsigned long long)parser.unknown);
+	}
+
+	if (decode) return 0;
+
+	if (!analysis.write(directory))
+	{
+		std::fprintf(stderr, "Can't write the tables in %s\n", directory.c_str());
+		return 1;
+	}
+	analysis.summary(binary);
+
+	return 0;
+}